@@ -1,33 +1,87 @@
 #include "Chip8.h"
+#include "Chip8_trace.h"
+#include "Chip8_debug.h"
+#include "Chip8_metrics.h"
+#include "Chip8_aot.h"
 #include <stdio.h>
 #include <string.h>
 
+void (*chip8_getKeystate)(Chip8 *chip8) = NULL;
+void (*chip8_drawScreen)(Chip8 *chip8) = NULL;
+uint32_t (*chip8_get_tick)() = NULL;
+void (*chip8_beep)() = NULL;
+
 uint16_t rom_size = 0;
 char *rom_name;
 uint32_t start_time = 0;
 uint16_t currentPC = 0;
 
-void chip8_loadrom(Chip8 *chip8, char *romname) {
-    /* Clear system memory*/
-    memset(MEMORY, 0x00, memsize);
+#ifdef CHIP8_AOT
+/* Translated code is only valid for the rom it was translated from; any
+other rom is interpreted */
+static bool chip8_aot_matches(const uint8_t rom[], uint16_t length) {
+    return length == chip8_aot_rom_length && memcmp(rom, chip8_aot_rom, length) == 0;
+}
+#endif
+
+#ifndef CHIP8_XIP
 
+void chip8_loadrom(Chip8 *chip8, char *romname) {
     /* Open ROM and find its size*/
     FILE *fp = fopen(romname, "rb");
+    if(fp == NULL){
+        perror(romname);
+        return;
+    }
     fseek(fp, 0, SEEK_END);
-    uint16_t length = ftell(fp);
+    long size = ftell(fp);
     fseek(fp, 0, SEEK_SET);
+    if(size > CHIP8_MEMSIZE - 0x200){
+        fprintf(stderr, "%s: %ld bytes, only the first %d fit in memory\n", romname, size, CHIP8_MEMSIZE - 0x200);
+        size = CHIP8_MEMSIZE - 0x200;
+    }
+
+    /* Clear system memory*/
+    memset(MEMORY, 0x00, memsize);
 
     /* Copy necessary rom bytes into
     * system memory*/
-    fread(&MEMORY[0x200], 1, length, fp);
+    uint16_t length = fread(&MEMORY[0x200], 1, size, fp);
+    if(length != size){
+        fprintf(stderr, "%s: read %u of %ld bytes\n", romname, length, size);
+    }
+    fclose(fp);
+
+    #ifdef CHIP8_AOT
+    chip8->aot_modified = !chip8_aot_matches(&MEMORY[0x200], length);
+    #endif
+
     rom_size = length;
     rom_name = romname;
 }
-
-void chip8_loadmem(Chip8 *chip8, uint8_t rom[], uint16_t length) {
+#endif
+
+void chip8_loadmem(Chip8 *chip8, const uint8_t rom[], uint16_t length) {
+    #ifdef CHIP8_XIP
+    /* Nothing is copied: the ROM stays where it is, owned by the caller,
+    and the overlay starts out empty */
+    chip8->rom = rom;
+    chip8->rom_length = length;
+    chip8->overlay_used = 0;
+    memset(chip8->page_map, 0, sizeof(chip8->page_map));
+    #else
     /* Clear system memory*/
     memset(MEMORY, 0x00, memsize);
     memcpy(&MEMORY[0x200], rom, length);
+    #endif
+
+    #ifdef CHIP8_AOT
+    /* memory is pristine again, so translated code is valid if it was
+    translated from this rom */
+    chip8->aot_modified = !chip8_aot_matches(rom, length);
+    #endif
+
+    rom_size = length;
 }
 
 void chip8_bind_io(void (*getKeystate)(Chip8 *chip8), void (*drawScreen)(Chip8 *chip8),
@@ -51,7 +105,17 @@ void chip8_init(Chip8 *chip8) {
     }
 
     /* Copy fonts into system memory */
+    #ifdef CHIP8_XIP
+    /* the font is read from chip8_font; only restore it if a write
+    has pulled it into the overlay */
+    for(uint16_t i = 0; i < sizeof(chip8_font); i++){
+        if(chip8->page_map[i / CHIP8_PAGE_SIZE] != 0){
+            MEM_WRITE(i, chip8_font[i]);
+        }
+    }
+    #else
     memcpy(MEMORY, chip8_font, 80);
+    #endif
 
     HALT = false;
     PAUSE = false;
@@ -65,7 +129,74 @@ void chip8_init(Chip8 *chip8) {
     I = 0x0;
     INSTRUCTION = 0x0000;
 
-    start_time = chip8_get_tick();
+    DELAY = 0;
+    SOUND = 0;
+    chip8->frames = 0;
+    chip8_seed(chip8, time(0));
+
+    if(chip8_get_tick != NULL){
+        start_time = chip8_get_tick();
+    }
+
+    CHIP8_DEBUG_RESET(chip8);
+}
+
+/* Seeds the per-instance generator used by CXNN. chip8_init seeds from the
+* wall clock; replays and tests seed explicitly after init */
+void chip8_seed(Chip8 *chip8, uint32_t seed) {
+    /* xorshift32 must never hold zero */
+    chip8->rng = seed ? seed : 0x2545F491;
+}
+
+static uint32_t chip8_random(Chip8 *chip8) {
+    uint32_t r = chip8->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    chip8->rng = r;
+    return r;
+}
+
+/* Copies the complete machine state. Snapshots are plain Chip8 values, so
+* taking one is a single struct copy; hooks attached to the source (trace,
+* debugger) are not carried over */
+void chip8_snapshot(const Chip8 *chip8, Chip8 *snapshot) {
+    *snapshot = *chip8;
+
+    #ifdef CHIP8_TRACE
+    snapshot->trace = NULL;
+    #endif
+    #ifdef CHIP8_DEBUG
+    snapshot->debug = NULL;
+    #endif
+    #ifdef CHIP8_METRICS
+    snapshot->metrics = NULL;
+    #endif
+}
+
+/* Rewinds an instance to a snapshot, keeping the instance's own hooks */
+void chip8_restore(Chip8 *chip8, const Chip8 *snapshot) {
+    #ifdef CHIP8_TRACE
+    struct Chip8_trace_t *trace = chip8->trace;
+    #endif
+    #ifdef CHIP8_DEBUG
+    struct Chip8_debug_t *debug = chip8->debug;
+    #endif
+    #ifdef CHIP8_METRICS
+    struct Chip8_metrics_t *metrics = chip8->metrics;
+    #endif
+
+    *chip8 = *snapshot;
+
+    #ifdef CHIP8_TRACE
+    chip8->trace = trace;
+    #endif
+    #ifdef CHIP8_DEBUG
+    chip8->debug = debug;
+    #endif
+    #ifdef CHIP8_METRICS
+    chip8->metrics = metrics;
+    #endif
 }
 
 void chip8_clockcycle(Chip8 *chip8) {
@@ -78,31 +209,12 @@ void chip8_clockcycle(Chip8 *chip8) {
         dt = elapsed - start_time;
 
         if(dt > 3){
-            // fetch instruction
-            INSTRUCTION = (MEMORY[PC] << 8) | (MEMORY[PC + 1]);
-
             currentPC = PC;
-
-            // increment program counter
-            PC += 2;
-
-            // decode instruction
-            chip8_decode(chip8);
-
+            chip8_step(chip8);
         }
 
         if (dt > 16 ) {
-
-            if(DELAY > 0){
-                DELAY -= 1;
-            }
-
-            if(SOUND > 0){
-                SOUND -= 1;
-                if(chip8_beep != NULL){
-                    chip8_beep();
-                }
-            }
+            chip8_tick_timers(chip8);
 
             start_time = elapsed;
             elapsed = 0;
@@ -120,6 +232,119 @@ void chip8_clockcycle(Chip8 *chip8) {
 
 }
 
+/* True while a hook has to see every instruction */
+static inline bool chip8_hooked(const Chip8 *chip8) {
+    #ifdef CHIP8_TRACE
+    if(chip8->trace != NULL){
+        return true;
+    }
+    #endif
+    #ifdef CHIP8_DEBUG
+    if(chip8->debug != NULL){
+        return true;
+    }
+    #endif
+    return false;
+}
+
+/* Fetches, decodes and executes a single instruction. hooked is constant
+* at every call site, so the copy chip8_frame runs for an instance nobody
+* traces or debugs has no per-instruction trace or breakpoint test at all */
+static inline void chip8_execute(Chip8 *chip8, bool hooked) {
+    uint16_t pc = PC;
+
+    if(hooked && !CHIP8_DEBUG_GATE(chip8)){
+        return;
+    }
+
+    // fetch instruction
+    INSTRUCTION = (MEM_READ(pc) << 8) | MEM_READ(pc + 1);
+
+    // increment program counter
+    PC += 2;
+
+    // decode instruction
+    chip8_decode(chip8);
+
+    if(hooked){
+        CHIP8_TRACE_STEP(chip8, pc);
+    }
+    CHIP8_METRICS_ADD(chip8, instructions, 1);
+}
+
+/* Fetches, decodes and executes a single instruction, independent
+* of wall-clock timing */
+void chip8_step(Chip8 *chip8) {
+    chip8_execute(chip8, true);
+}
+
+/* Runs one 60Hz frame: a fixed number of instructions followed by a
+* timer tick. Used by frontends that pace emulation to the display rather
+* than to chip8_get_tick */
+void chip8_frame(Chip8 *chip8, uint16_t cycles) {
+    #ifdef CHIP8_AOT
+    /* run translated code, interpreting only what it hands back; an
+    instance loaded with another rom starts out aot_modified and is
+    interpreted throughout */
+    uint32_t budget = cycles;
+    while(budget > 0 && !HALT && !PAUSE){
+        if(!chip8->aot_modified){
+            uint32_t before = budget;
+            int status = chip8_aot_run(chip8, &budget);
+            CHIP8_METRICS_ADD(chip8, instructions, before - budget);
+            if(status == CHIP8_AOT_OK){
+                continue;
+            }
+            if(status == CHIP8_AOT_MODIFIED){
+                chip8->aot_modified = true;
+            }
+            if(budget == 0 || HALT){
+                continue;
+            }
+        }
+        chip8_step(chip8);
+        budget--;
+    }
+    #else
+    /* hooks are only attached between frames: the debugger arms itself
+    from commands polled by the frontend, and only ever disarms mid-frame */
+    if(chip8_hooked(chip8)){
+        for(uint16_t i = 0; i < cycles && !HALT && !PAUSE; i++){
+            chip8_execute(chip8, true);
+        }
+    }
+    else{
+        for(uint16_t i = 0; i < cycles && !HALT && !PAUSE; i++){
+            chip8_execute(chip8, false);
+        }
+    }
+    #endif
+
+    if(!PAUSE){
+        chip8_tick_timers(chip8);
+    }
+    else{
+        CHIP8_METRICS_ADD(chip8, frames_paused, 1);
+    }
+}
+
+/* Decrements the delay and sound timers. Called at 60Hz */
+void chip8_tick_timers(Chip8 *chip8) {
+    if(DELAY > 0){
+        DELAY -= 1;
+    }
+
+    if(SOUND > 0){
+        SOUND -= 1;
+        if(chip8_beep != NULL){
+            chip8_beep();
+        }
+    }
+
+    chip8->frames++;
+    CHIP8_METRICS_TICK(chip8);
+}
+
 void chip8_decode(Chip8 *chip8) {
     /* Extract Instruction opcode */
     uint16_t opcode = INSTRUCTION & 0xF000;
@@ -323,8 +548,7 @@ void chip8_opB(Chip8 *chip8) {
 /* CXNN - Sets VX to the result of a bitwise
 * and operation on a random number and NN */
 void chip8_opC(Chip8 *chip8) {
-    srand(time(0));
-    V[X] = NN & (rand() % 0xFF);
+    V[X] = NN & (chip8_random(chip8) % 0xFF);
 }
 
 /* DXYN - Draws a sprite at coordinate (VX, VY) that has
@@ -334,8 +558,9 @@ void chip8_opD(Chip8 *chip8) {
     V[0xF] = 0;
     uint8_t xx = V[X];
     uint8_t yy = V[Y];
+    CHIP8_WATCH_READ(chip8, I, N);
     for(int i = 0; i < N; i++){
-        uint8_t pixel = MEMORY[I + i];
+        uint8_t pixel = MEM_READ(I + i);
         for(int j = 0; j < 8; j++){
             if( (pixel & (0x80 >> j)) != 0x00){
                 if(PIXELTEST(xx+j, yy+i))
@@ -344,6 +569,8 @@ void chip8_opD(Chip8 *chip8) {
             }
         }
     }
+    CHIP8_METRICS_ADD(chip8, draws, 1);
+    CHIP8_METRICS_ADD(chip8, collisions, V[0xF]);
 
 }
 
@@ -367,22 +594,18 @@ void chip8_opF(Chip8 *chip8) {
         V[X] = DELAY;
     }
 
-    /* FX0A - A key press is awaited, and then stored in VX. (Blocking Operation.
-    * All instruction halted until next key event */
+    /* FX0A - A key press is awaited, and then stored in VX. Rather than
+    * blocking inside the opcode, the instruction is re-executed until a key
+    * is down, so the frontend keeps polling input and presenting frames */
     else if(NN == 0x0A){
-        bool wait = true;
-        while(wait && !HALT){
-            if(chip8_getKeystate != NULL){
-                chip8_getKeystate(chip8);
-            }
-            for(uint8_t i = 0; i < 16; i++){
-                if(KEYTEST(i) != 0){
-                    V[X] = i;
-                    wait = false;
-                    return;
-                }
+        for(uint8_t i = 0; i < 16; i++){
+            if(KEYTEST(i) != 0){
+                V[X] = i;
+                return;
             }
         }
+        PC -= 2;
+        CHIP8_METRICS_KEY_WAIT(chip8);
     }
 
     /* FX15 - Sets the delay timer to VX */
@@ -415,16 +638,18 @@ void chip8_opF(Chip8 *chip8) {
         uint16_t tens = (val - 100*(val/100)) / 10;
         uint16_t ones = val - (hundreds*100 + tens*10);
 
-        MEMORY[I] = hundreds;
-        MEMORY[I + 1] = tens;
-        MEMORY[I + 2] = ones;
+        CHIP8_WATCH_WRITE(chip8, I, 3);
+        MEM_WRITE(I, hundreds);
+        MEM_WRITE(I + 1, tens);
+        MEM_WRITE(I + 2, ones);
     }
 
     /* FX55 - Stores V0 to VX (including VX) in memory starting
     * at address I. I is increased by 1 for each value written. */
     else if(NN == 0x55){
+        CHIP8_WATCH_WRITE(chip8, I, X + 1);
         for(int i = 0; i <= X; i++){
-            MEMORY[I + i] = V[i];
+            MEM_WRITE(I + i, V[i]);
         }
         I += (X + 1);
     }
@@ -432,8 +657,9 @@ void chip8_opF(Chip8 *chip8) {
     /* FX65 - Fills V0 to VX (including VX) with values from memory starting at
     * address I. I is increased by 1 for each value written. */
     else if(NN == 0x65){
+        CHIP8_WATCH_READ(chip8, I, X + 1);
         for(int i = 0; i <= X; i++){
-            V[i] = MEMORY[I + i];
+            V[i] = MEM_READ(I + i);
         }
         I += (X + 1);
     }
@@ -451,7 +677,7 @@ void chip8_printRom(Chip8 *chip8) {
     printf("**************************\n");
     for (uint16_t i = 0x200; i < 0x200 + rom_size; i++) {
         printf("0x%04x: ", (unsigned short) i);
-        printf("%x", (unsigned char) MEMORY[i] & 0xff);
+        printf("%x", (unsigned char) MEM_READ(i) & 0xff);
         printf("\n");
     }
 }
@@ -464,7 +690,74 @@ void chip8_printMem(Chip8 *chip8) {
     uint16_t memsize = 4096;
     for (uint16_t i = 0; i < memsize; i++) {
         printf("0x%04x: ", (unsigned short) i);
-        printf("%02hhX", (unsigned char) MEMORY[i] & 0xff);
+        printf("%02hhX", (unsigned char) MEM_READ(i) & 0xff);
         printf("\n");
     }
 }
+
+/* Writes a Cowgod-style mnemonic for an instruction into buf */
+void chip8_disassemble(uint16_t instruction, char *buf, size_t len) {
+    uint8_t x = (instruction & 0x0F00) >> 8;
+    uint8_t y = (instruction & 0x00F0) >> 4;
+    uint16_t nnn = instruction & 0x0FFF;
+    uint8_t nn = instruction & 0x00FF;
+    uint8_t n = instruction & 0x000F;
+
+    switch (instruction & 0xF000) {
+        case 0x0000:
+        if (instruction == 0x00E0) snprintf(buf, len, "CLS");
+        else if (instruction == 0x00EE) snprintf(buf, len, "RET");
+        else snprintf(buf, len, "SYS  0x%03X", nnn);
+        break;
+
+        case 0x1000: snprintf(buf, len, "JP   0x%03X", nnn); break;
+        case 0x2000: snprintf(buf, len, "CALL 0x%03X", nnn); break;
+        case 0x3000: snprintf(buf, len, "SE   V%X, 0x%02X", x, nn); break;
+        case 0x4000: snprintf(buf, len, "SNE  V%X, 0x%02X", x, nn); break;
+        case 0x5000: snprintf(buf, len, "SE   V%X, V%X", x, y); break;
+        case 0x6000: snprintf(buf, len, "LD   V%X, 0x%02X", x, nn); break;
+        case 0x7000: snprintf(buf, len, "ADD  V%X, 0x%02X", x, nn); break;
+
+        case 0x8000:
+        switch (n) {
+            case 0x0: snprintf(buf, len, "LD   V%X, V%X", x, y); break;
+            case 0x1: snprintf(buf, len, "OR   V%X, V%X", x, y); break;
+            case 0x2: snprintf(buf, len, "AND  V%X, V%X", x, y); break;
+            case 0x3: snprintf(buf, len, "XOR  V%X, V%X", x, y); break;
+            case 0x4: snprintf(buf, len, "ADD  V%X, V%X", x, y); break;
+            case 0x5: snprintf(buf, len, "SUB  V%X, V%X", x, y); break;
+            case 0x6: snprintf(buf, len, "SHR  V%X", x); break;
+            case 0x7: snprintf(buf, len, "SUBN V%X, V%X", x, y); break;
+            case 0xE: snprintf(buf, len, "SHL  V%X", x); break;
+            default: snprintf(buf, len, "DW   0x%04X", instruction); break;
+        }
+        break;
+
+        case 0x9000: snprintf(buf, len, "SNE  V%X, V%X", x, y); break;
+        case 0xA000: snprintf(buf, len, "LD   I, 0x%03X", nnn); break;
+        case 0xB000: snprintf(buf, len, "JP   V0, 0x%03X", nnn); break;
+        case 0xC000: snprintf(buf, len, "RND  V%X, 0x%02X", x, nn); break;
+        case 0xD000: snprintf(buf, len, "DRW  V%X, V%X, %u", x, y, n); break;
+
+        case 0xE000:
+        if (nn == 0x9E) snprintf(buf, len, "SKP  V%X", x);
+        else if (nn == 0xA1) snprintf(buf, len, "SKNP V%X", x);
+        else snprintf(buf, len, "DW   0x%04X", instruction);
+        break;
+
+        case 0xF000:
+        switch (nn) {
+            case 0x07: snprintf(buf, len, "LD   V%X, DT", x); break;
+            case 0x0A: snprintf(buf, len, "LD   V%X, K", x); break;
+            case 0x15: snprintf(buf, len, "LD   DT, V%X", x); break;
+            case 0x18: snprintf(buf, len, "LD   ST, V%X", x); break;
+            case 0x1E: snprintf(buf, len, "ADD  I, V%X", x); break;
+            case 0x29: snprintf(buf, len, "LD   F, V%X", x); break;
+            case 0x33: snprintf(buf, len, "LD   B, V%X", x); break;
+            case 0x55: snprintf(buf, len, "LD   [I], V%X", x); break;
+            case 0x65: snprintf(buf, len, "LD   V%X, [I]", x); break;
+            default: snprintf(buf, len, "DW   0x%04X", instruction); break;
+        }
+        break;
+    }
+}
@@ -9,6 +9,7 @@ extern "C" {
     #include <stdio.h>
     #include <stdlib.h>
     #include <stdbool.h>
+    #include <stddef.h>
     #include <time.h>
 
     /*
@@ -23,6 +24,8 @@ extern "C" {
 
     #define INSTRUCTION (chip8->instruction)
     #define MEMORY (chip8->memory)
+    #define MEM_READ(A) chip8_mem_read(chip8, (A))
+    #define MEM_WRITE(A, VAL) chip8_mem_write(chip8, (A), (VAL))
     #define STACK (chip8->stack)
     #define SP (chip8->sp)
     #define PC (chip8->pc)
@@ -42,14 +45,61 @@ extern "C" {
     #define DISPLAY (chip8->display)
     #define DISPLAY_WIDTH 64
     #define DISPLAY_HEIGHT 32
-    #define PIXELXOR(I, J) DISPLAY[(I)/8][(J) % 32] ^= (1 << ((I) % 8))
-    #define PIXELTEST(I, J) (DISPLAY[(I)/8][(J) % 32]) & (1 << ((I) % 8))
+    #define PIXELXOR(I, J) DISPLAY[((I) % DISPLAY_WIDTH)/8][(J) % DISPLAY_HEIGHT] ^= (1 << ((I) % 8))
+    #define PIXELTEST(I, J) (DISPLAY[((I) % DISPLAY_WIDTH)/8][(J) % DISPLAY_HEIGHT]) & (1 << ((I) % 8))
 
+    #define CHIP8_MEMSIZE 4096
+
+    /* instructions executed per 60Hz frame by chip8_frame (600Hz) */
+    #ifndef CHIP8_CYCLES_PER_FRAME
+    #define CHIP8_CYCLES_PER_FRAME 10
+    #endif
+
+    /* XIP overlay geometry: page size in bytes, and how many written pages
+    can be held in RAM. Both may be overridden from the build */
+    #ifndef CHIP8_PAGE_SIZE
+    #define CHIP8_PAGE_SIZE 64
+    #endif
+    #ifndef CHIP8_OVERLAY_PAGES
+    #define CHIP8_OVERLAY_PAGES 8
+    #endif
+
+    /* INSTANCES ARE LAID OUT IN 64 BYTE CACHE LINES, SEE Chip8 BELOW */
+    #define CHIP8_CACHE_LINE 64
+    #define CHIP8_LINES(bytes) (((bytes) + CHIP8_CACHE_LINE - 1) / CHIP8_CACHE_LINE)
+
+    /* lines taken by the fields of Chip8, before the stride padding: the hot
+    line, the stack line, [the page map,] the display and memory */
+    #ifdef CHIP8_XIP
+    #define CHIP8_STATE_LINES (2 + CHIP8_LINES(CHIP8_MEMSIZE / CHIP8_PAGE_SIZE) + CHIP8_LINES(256) \
+    + CHIP8_LINES(CHIP8_OVERLAY_PAGES * CHIP8_PAGE_SIZE))
+    #else
+    #define CHIP8_STATE_LINES (2 + CHIP8_LINES(256) + CHIP8_LINES(CHIP8_MEMSIZE))
+    #endif
+
+    /*
+    MACHINE STATE, ORDERED BY HOW OFTEN chip8_step TOUCHES IT. THE FIRST CACHE
+    LINE HOLDS EVERYTHING READ OR WRITTEN ON EVERY INSTRUCTION: THE REGISTERS,
+    PC, I, SP, TIMERS, KEYPAD, FLAGS AND THE HOOK POINTERS. THE STACK, ONLY
+    USED BY 2NNN AND 00EE, STARTS THE SECOND LINE. THE DISPLAY AND MEMORY
+    FOLLOW.
+
+    THE STRUCT IS CACHE LINE ALIGNED, SO ITS SIZE IS A MULTIPLE OF A LINE AND
+    NO TWO INSTANCES IN AN ARRAY SHARE ONE; THREADS STEPPING NEIGHBOURING
+    INSTANCES NEVER FALSE-SHARE. STATIC AND AUTOMATIC INSTANCES GET THIS FROM
+    THE COMPILER; ALLOCATE HEAP INSTANCES WITH aligned_alloc(CHIP8_CACHE_LINE,
+    ...).
+
+    THE SIZE IS ALSO PADDED TO AN ODD NUMBER OF LINES. CACHES PICK A LINE'S
+    SET FROM THE LOW ADDRESS BITS, AND WITH AN EVEN STRIDE (70 LINES FLAT)
+    THE HOT LINES OF AN ARRAY OF INSTANCES ONLY EVER LAND IN HALF OF THE SETS,
+    SO THOUSANDS OF INSTANCES THRASH L2 LONG BEFORE IT IS FULL. AN ODD STRIDE
+    SPREADS THEM OVER EVERY SET.
+    */
     typedef struct Chip8_t {
 
-        /* wait and halt flags */
-        bool halt;
-        bool pause;
+        /* V registers */
+        uint8_t regV[16] __attribute__((aligned(CHIP8_CACHE_LINE)));
 
         /* program counter */
         uint16_t pc;
@@ -57,21 +107,61 @@ extern "C" {
         /* current instruction */
         uint16_t instruction;
 
-        /* memory */
-        uint8_t memory[4096];
-
-        /* V and I registers */
-        uint8_t regV[16];
+        /* I register and stack pointer */
         uint16_t regI;
-
-        /* stack and stack pointer*/
-        uint16_t stack[16];
         uint16_t sp;
 
+        /*  KEYPAD REGISTER, REPRESENTED AS AN UNSIGNED 16 INTEGER*/
+        uint16_t keypad;
+
         /* timers */
         uint8_t delay;
         uint8_t sound;
 
+        /* wait and halt flags */
+        bool halt;
+        bool pause;
+
+        #ifdef CHIP8_AOT
+        /* translated code was overwritten or is for another rom,
+        interpret from now on */
+        bool aot_modified;
+        #endif
+
+        /* number of 60Hz timer ticks since init */
+        uint32_t frames;
+
+        /* CXNN random number generator state */
+        uint32_t rng;
+
+        #ifdef CHIP8_TRACE
+        /* execution trace ring, NULL when not tracing */
+        struct Chip8_trace_t *trace;
+        #endif
+
+        #ifdef CHIP8_DEBUG
+        /* attached debugger, NULL unless something is armed */
+        struct Chip8_debug_t *debug;
+        #endif
+
+        #ifdef CHIP8_METRICS
+        /* runtime counters, NULL when not exported */
+        struct Chip8_metrics_t *metrics;
+        #endif
+
+        /* stack */
+        uint16_t stack[16] __attribute__((aligned(CHIP8_CACHE_LINE)));
+
+        #ifdef CHIP8_XIP
+        /* EXECUTE-IN-PLACE BACKEND. THE ROM IS READ STRAIGHT FROM FLASH (OR ANY
+        CONST ARRAY) AND THE FONT FROM chip8_font. ONLY PAGES THAT THE PROGRAM
+        WRITES ARE COPIED INTO THE SMALL RAM OVERLAY BELOW. */
+        const uint8_t *rom;
+        uint16_t rom_length;
+        uint8_t overlay_used;
+        uint8_t page_map[CHIP8_MEMSIZE / CHIP8_PAGE_SIZE] __attribute__((aligned(CHIP8_CACHE_LINE)));
+        #endif
+
         /* I/O */
         /* CHIP8 GRAPHICS BUFFER. REPRESENTED AS AN 8X32 uint8_t ARRAY, AS
         OPPOSED TO CONVENTIONAL IMPLEMENTATIONS THAT USE uint8_t[64*32].
@@ -79,14 +169,28 @@ extern "C" {
         IS HELPFUL FOR RUNNING ON EMBEDDED PLATFORMS, WHERE RESOURCES ARE
         LIMITED.
         */
-        uint8_t display[8][32];
-        /*  KEYPAD REGISTER, REPRESENTED AS AN UNSIGNED 16 INTEGER*/
-        uint16_t keypad;
+        uint8_t display[8][32] __attribute__((aligned(CHIP8_CACHE_LINE)));
+
+        /* memory */
+        #ifdef CHIP8_XIP
+        uint8_t overlay[CHIP8_OVERLAY_PAGES][CHIP8_PAGE_SIZE];
+        #else
+        uint8_t memory[CHIP8_MEMSIZE];
+        #endif
 
+        /* one line when the fields above take an even number, see above */
+        uint8_t stride_pad[CHIP8_STATE_LINES % 2 ? 0 : CHIP8_CACHE_LINE] __attribute__((aligned(CHIP8_CACHE_LINE)));
 
     } Chip8;
 
-    static const uint16_t memsize = 4096;
+    /* every per-instruction field must stay in the first line, and arrays
+    of instances must have an odd stride */
+    #ifndef __cplusplus
+    _Static_assert(offsetof(Chip8, stack) == CHIP8_CACHE_LINE, "Chip8 hot fields exceed one cache line");
+    _Static_assert(sizeof(Chip8) / CHIP8_CACHE_LINE % 2 == 1, "Chip8 is an even number of cache lines");
+    #endif
+
+    static const uint16_t memsize = CHIP8_MEMSIZE;
     static const uint8_t chip8_font[] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, //0
         0x20, 0x60, 0x20, 0x20, 0x70, //1
@@ -106,14 +210,78 @@ extern "C" {
         0xF0, 0x80, 0xF0, 0x80, 0x80 //F
     };
 
-    /* initialization and runtime routines */
+    /*
+    MEMORY ACCESSORS. ALL EMULATED MEMORY ACCESS GOES THROUGH THESE, SO THE
+    BACKEND IS PICKED AT COMPILE TIME: A FLAT 4KB ARRAY BY DEFAULT, OR WITH
+    CHIP8_XIP, AN EXECUTE-IN-PLACE ROM WITH A COPY-ON-WRITE RAM OVERLAY.
+    ADDRESSES WRAP AT 4KB.
+    */
+    #ifdef CHIP8_XIP
+    static inline uint8_t chip8_mem_backing(const Chip8 *chip8, uint16_t addr) {
+        if (addr < sizeof(chip8_font))
+        return chip8_font[addr];
+        if (addr >= 0x200 && addr - 0x200 < chip8->rom_length)
+        return chip8->rom[addr - 0x200];
+        return 0x00;
+    }
+
+    static inline uint8_t chip8_mem_read(const Chip8 *chip8, uint16_t addr) {
+        addr &= CHIP8_MEMSIZE - 1;
+        uint8_t slot = chip8->page_map[addr / CHIP8_PAGE_SIZE];
+        if (slot != 0)
+        return chip8->overlay[slot - 1][addr % CHIP8_PAGE_SIZE];
+        return chip8_mem_backing(chip8, addr);
+    }
+
+    /* Materializes the page on first write. When the overlay is exhausted the
+    machine halts, since the write cannot be honoured */
+    static inline void chip8_mem_write(Chip8 *chip8, uint16_t addr, uint8_t value) {
+        addr &= CHIP8_MEMSIZE - 1;
+        uint16_t page = addr / CHIP8_PAGE_SIZE;
+        uint8_t slot = chip8->page_map[page];
+
+        if (slot == 0) {
+            if (chip8->overlay_used == CHIP8_OVERLAY_PAGES) {
+                chip8->halt = true;
+                return;
+            }
+            slot = ++chip8->overlay_used;
+            for (uint16_t i = 0; i < CHIP8_PAGE_SIZE; i++)
+            chip8->overlay[slot - 1][i] = chip8_mem_backing(chip8, page * CHIP8_PAGE_SIZE + i);
+            chip8->page_map[page] = slot;
+        }
+        chip8->overlay[slot - 1][addr % CHIP8_PAGE_SIZE] = value;
+    }
+    #else
+    static inline uint8_t chip8_mem_read(const Chip8 *chip8, uint16_t addr) {
+        return chip8->memory[addr & (CHIP8_MEMSIZE - 1)];
+    }
+
+    static inline void chip8_mem_write(Chip8 *chip8, uint16_t addr, uint8_t value) {
+        chip8->memory[addr & (CHIP8_MEMSIZE - 1)] = value;
+    }
+    #endif
+
+    /* initialization and runtime routines. The XIP backend has no file
+    loader: it executes a caller-owned image handed to chip8_loadmem, which
+    must outlive the instance */
+    #ifndef CHIP8_XIP
     void chip8_loadrom(Chip8 *chip8, char *romname);
-    void chip8_loadmem(Chip8 *chip8, uint8_t rom[], uint16_t length);
+    #endif
+    void chip8_loadmem(Chip8 *chip8, const uint8_t rom[], uint16_t length);
     void chip8_init(Chip8 *chip8);
+    void chip8_seed(Chip8 *chip8, uint32_t seed);
 
     void chip8_clockcycle(Chip8 *chip8);
+    void chip8_step(Chip8 *chip8);
+    void chip8_frame(Chip8 *chip8, uint16_t cycles);
+    void chip8_tick_timers(Chip8 *chip8);
     void chip8_decode(Chip8 *chip8);
 
+    /* savestate routines */
+    void chip8_snapshot(const Chip8 *chip8, Chip8 *snapshot);
+    void chip8_restore(Chip8 *chip8, const Chip8 *snapshot);
+
     /* opcode decoding functions */
     void chip8_op0(Chip8 *chip8);
     void chip8_op1(Chip8 *chip8);
@@ -135,15 +303,16 @@ extern "C" {
     /* I/O Routines*/
     void chip8_bind_io(void (*getKeystate)(Chip8 *chip8), void (*drawScreen)(Chip8 *chip8),
     uint32_t (*_get_tick)(), void (*_beep)());
-    void (*chip8_getKeystate)(Chip8 *chip8);
-    void (*chip8_drawScreen)(Chip8 *chip8);
-    uint32_t (*chip8_get_tick)();
-    void (*chip8_beep)();
+    extern void (*chip8_getKeystate)(Chip8 *chip8);
+    extern void (*chip8_drawScreen)(Chip8 *chip8);
+    extern uint32_t (*chip8_get_tick)();
+    extern void (*chip8_beep)();
 
     /* Debugging Routines*/
     void chip8_printCurrentInstruction(Chip8 *chip8);
     void chip8_printRom(Chip8 *chip8);
     void chip8_printMem(Chip8 *chip8);
+    void chip8_disassemble(uint16_t instruction, char *buf, size_t len);
 
 
     #ifdef __cplusplus
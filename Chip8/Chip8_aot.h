@@ -0,0 +1,38 @@
+#ifndef CHIP8_AOT_H
+#define CHIP8_AOT_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+
+    /*
+    AHEAD-OF-TIME TRANSLATED ROMS. tools/chip8_aot.c TURNS A ROM INTO A C FILE
+    DEFINING THE SYMBOLS BELOW; LINKED INTO A CORE BUILT WITH CHIP8_AOT,
+    chip8_frame RUNS THE TRANSLATED CODE INSTEAD OF DECODING INSTRUCTIONS.
+
+    chip8_aot_run EXECUTES UP TO *budget INSTRUCTIONS AND DECREMENTS IT BY
+    THE NUMBER EXECUTED. IT RETURNS
+        CHIP8_AOT_OK        WHEN THE BUDGET IS USED UP,
+        CHIP8_AOT_FALLBACK  WHEN PC REACHES AN ADDRESS THAT WAS NOT TRANSLATED
+                            (THE CORE INTERPRETS ONE INSTRUCTION AND RE-ENTERS),
+        CHIP8_AOT_MODIFIED  WHEN A STORE OVERWROTE TRANSLATED CODE (THE CORE
+                            INTERPRETS FROM THEN ON).
+    BREAKPOINTS AND TRACE HOOKS ONLY SEE INTERPRETED INSTRUCTIONS.
+    */
+    #define CHIP8_AOT_OK 0
+    #define CHIP8_AOT_FALLBACK 1
+    #define CHIP8_AOT_MODIFIED 2
+
+    int chip8_aot_run(Chip8 *chip8, uint32_t *budget);
+
+    extern const uint8_t chip8_aot_rom[];
+    extern const uint16_t chip8_aot_rom_length;
+    extern const char chip8_aot_rom_name[];
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_AOT_H */
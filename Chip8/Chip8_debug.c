@@ -0,0 +1,553 @@
+#include "Chip8_debug.h"
+
+#ifdef CHIP8_DEBUG
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static void debug_out(Chip8_debug *dbg, const char *fmt, ...) {
+    if (dbg->out_fd < 0)
+    return;
+
+    va_list args;
+    va_start(args, fmt);
+    vdprintf(dbg->out_fd, fmt, args);
+    va_end(args);
+}
+
+/*
+Attaches the debugger to the instance only while there is something for
+the per-instruction hooks to do. Otherwise chip8->debug stays NULL and the
+interpreter runs its normal path.
+*/
+static void debug_rearm(Chip8_debug *dbg) {
+    bool armed = dbg->steps >= 0;
+
+    for (int i = 0; i < CHIP8_DEBUG_MAX_BREAKPOINTS; i++)
+    armed |= dbg->breakpoints[i].used;
+    for (int i = 0; i < CHIP8_DEBUG_MAX_WATCHPOINTS; i++)
+    armed |= dbg->watchpoints[i].used;
+
+    dbg->chip8->debug = armed ? dbg : NULL;
+}
+
+/* A step-over that is still pending when the machine stops for another
+reason is abandoned, so its breakpoint does not fire on some later run */
+static void debug_clear_temporary(Chip8_debug *dbg) {
+    for (int i = 0; i < CHIP8_DEBUG_MAX_BREAKPOINTS; i++) {
+        if (dbg->breakpoints[i].temporary)
+        dbg->breakpoints[i].used = false;
+    }
+}
+
+static void debug_stop(Chip8_debug *dbg, const char *reason) {
+    Chip8 *chip8 = dbg->chip8;
+    char text[32];
+
+    PAUSE = true;
+    dbg->steps = -1;
+    debug_clear_temporary(dbg);
+    debug_rearm(dbg);
+
+    chip8_disassemble((MEM_READ(PC) << 8) | MEM_READ(PC + 1), text, sizeof(text));
+    debug_out(dbg, "stopped %s at 0x%03X: %s\n", reason, PC, text);
+}
+
+static void debug_resume(Chip8_debug *dbg, int32_t steps) {
+    Chip8 *chip8 = dbg->chip8;
+
+    dbg->steps = steps;
+    dbg->resume = true;
+    PAUSE = false;
+    debug_rearm(dbg);
+}
+
+static bool debug_cond(const Chip8_breakpoint *bp, const Chip8 *chip8) {
+    uint8_t reg = chip8->regV[bp->reg];
+
+    switch (bp->cond) {
+        case CHIP8_COND_EQ: return reg == bp->value;
+        case CHIP8_COND_NE: return reg != bp->value;
+        case CHIP8_COND_LT: return reg < bp->value;
+        case CHIP8_COND_GT: return reg > bp->value;
+        default: return true;
+    }
+}
+
+/*
+Called before each instruction while the debugger is armed. Returns false
+when the instruction at PC must not execute.
+*/
+bool chip8_debug_check(Chip8_debug *dbg, Chip8 *chip8) {
+    char reason[32];
+
+    if (PAUSE)
+    return false;
+
+    if (!dbg->resume) {
+        for (int i = 0; i < CHIP8_DEBUG_MAX_BREAKPOINTS; i++) {
+            Chip8_breakpoint *bp = &dbg->breakpoints[i];
+            if (bp->used && bp->temporary && bp->sp >= 0 && SP < bp->sp) {
+                /* the stack unwound past the call without returning to it */
+                debug_stop(dbg, "step");
+                return false;
+            }
+            if (!bp->used || bp->pc != PC || (bp->sp >= 0 && bp->sp != SP) || !debug_cond(bp, chip8))
+            continue;
+
+            if (bp->temporary) {
+                snprintf(reason, sizeof(reason), "step");
+            }
+            else {
+                snprintf(reason, sizeof(reason), "breakpoint %d", i);
+            }
+            debug_stop(dbg, reason);
+            return false;
+        }
+    }
+    dbg->resume = false;
+
+    if (dbg->steps == 0) {
+        debug_stop(dbg, "step");
+        return false;
+    }
+    if (dbg->steps > 0)
+    dbg->steps--;
+
+    return true;
+}
+
+/*
+Called by chip8_init while the debugger is armed. A pending step-over
+belongs to a call the reset just discarded, so it stops the machine at
+the entry point instead of waiting for a return that cannot come.
+*/
+void chip8_debug_reset(Chip8_debug *dbg, Chip8 *chip8) {
+    (void) chip8;
+
+    for (int i = 0; i < CHIP8_DEBUG_MAX_BREAKPOINTS; i++) {
+        if (dbg->breakpoints[i].used && dbg->breakpoints[i].temporary) {
+            debug_stop(dbg, "reset");
+            return;
+        }
+    }
+}
+
+/* Whether two ranges overlap, both wrapping at 4K like chip8_mem_write
+addresses do */
+static bool debug_overlap(uint16_t a, uint16_t a_len, uint16_t b, uint16_t b_len) {
+    if (a_len == 0 || b_len == 0)
+    return false;
+    return ((a - b) & (CHIP8_MEMSIZE - 1)) < b_len || ((b - a) & (CHIP8_MEMSIZE - 1)) < a_len;
+}
+
+/*
+Called by FX33/FX55 (writes) and FX65/DXYN (reads) with the memory range
+they touch. A hit lets the current instruction finish, then stops.
+*/
+void chip8_debug_access(Chip8_debug *dbg, Chip8 *chip8, uint16_t addr, uint16_t len, bool write) {
+    uint8_t mode = write ? CHIP8_WATCH_W : CHIP8_WATCH_R;
+
+    for (int i = 0; i < CHIP8_DEBUG_MAX_WATCHPOINTS; i++) {
+        Chip8_watchpoint *wp = &dbg->watchpoints[i];
+        if (!wp->used || !(wp->mode & mode))
+        continue;
+        if (!debug_overlap(addr, len, wp->addr, wp->len))
+        continue;
+
+        debug_out(dbg, "watch %d %s 0x%03X-0x%03X by 0x%04X\n", i, write ? "write" : "read",
+        addr & (CHIP8_MEMSIZE - 1), (addr + len - 1) & (CHIP8_MEMSIZE - 1), INSTRUCTION);
+        PAUSE = true;
+        dbg->steps = -1;
+        debug_clear_temporary(dbg);
+        debug_rearm(dbg);
+        return;
+    }
+}
+
+/******************************************************************************/
+
+static void debug_print_regs(Chip8_debug *dbg) {
+    Chip8 *chip8 = dbg->chip8;
+
+    debug_out(dbg, "PC=0x%03X I=0x%03X SP=%u DT=%u ST=%u KEYS=0x%04X FRAME=%u\n",
+    PC, I, SP, DELAY, SOUND, KEYPAD, chip8->frames);
+    for (int i = 0; i < 16; i++)
+    debug_out(dbg, "V%X=0x%02X%s", i, V[i], (i % 8 == 7) ? "\n" : " ");
+}
+
+static void debug_print_stack(Chip8_debug *dbg) {
+    Chip8 *chip8 = dbg->chip8;
+
+    for (int i = SP - 1; i >= 0; i--)
+    debug_out(dbg, "#%d 0x%03X\n", i, STACK[i]);
+}
+
+static void debug_print_display(Chip8_debug *dbg) {
+    Chip8 *chip8 = dbg->chip8;
+    char row[DISPLAY_WIDTH + 2];
+
+    for (uint8_t y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (uint8_t x = 0; x < DISPLAY_WIDTH; x++)
+        row[x] = PIXELTEST(x, y) ? '#' : '.';
+        row[DISPLAY_WIDTH] = '\n';
+        row[DISPLAY_WIDTH + 1] = '\0';
+        debug_out(dbg, "%s", row);
+    }
+}
+
+static void debug_print_mem(Chip8_debug *dbg, uint16_t addr, uint16_t len) {
+    Chip8 *chip8 = dbg->chip8;
+
+    for (uint16_t i = 0; i < len && addr + i < memsize; i++) {
+        if (i % 16 == 0)
+        debug_out(dbg, "%s0x%03X:", i ? "\n" : "", addr + i);
+        debug_out(dbg, " %02X", MEM_READ(addr + i));
+    }
+    debug_out(dbg, "\n");
+}
+
+static void debug_print_dis(Chip8_debug *dbg, uint16_t addr, uint16_t count) {
+    Chip8 *chip8 = dbg->chip8;
+    char text[32];
+
+    for (uint16_t i = 0; i < count && addr + 1 < memsize; i++, addr += 2) {
+        bool bp = false;
+        for (int b = 0; b < CHIP8_DEBUG_MAX_BREAKPOINTS; b++)
+        bp |= dbg->breakpoints[b].used && !dbg->breakpoints[b].temporary && dbg->breakpoints[b].pc == addr;
+
+        uint16_t instruction = (MEM_READ(addr) << 8) | MEM_READ(addr + 1);
+        chip8_disassemble(instruction, text, sizeof(text));
+        debug_out(dbg, "%s%s0x%03X: %04X  %s\n", addr == PC ? "=>" : "  ", bp ? "*" : " ",
+        addr, instruction, text);
+    }
+}
+
+static void debug_list(Chip8_debug *dbg) {
+    static const char *conds[] = {"", "==", "!=", "<", ">"};
+
+    for (int i = 0; i < CHIP8_DEBUG_MAX_BREAKPOINTS; i++) {
+        Chip8_breakpoint *bp = &dbg->breakpoints[i];
+        if (!bp->used || bp->temporary)
+        continue;
+        if (bp->cond == CHIP8_COND_NONE)
+        debug_out(dbg, "break %d 0x%03X\n", i, bp->pc);
+        else
+        debug_out(dbg, "break %d 0x%03X V%X %s 0x%02X\n", i, bp->pc, bp->reg, conds[bp->cond], bp->value);
+    }
+    for (int i = 0; i < CHIP8_DEBUG_MAX_WATCHPOINTS; i++) {
+        Chip8_watchpoint *wp = &dbg->watchpoints[i];
+        if (wp->used)
+        debug_out(dbg, "watch %d 0x%03X %u %s%s\n", i, wp->addr, wp->len,
+        (wp->mode & CHIP8_WATCH_R) ? "r" : "", (wp->mode & CHIP8_WATCH_W) ? "w" : "");
+    }
+}
+
+static int debug_add_breakpoint(Chip8_debug *dbg, Chip8_breakpoint *bp) {
+    for (int i = 0; i < CHIP8_DEBUG_MAX_BREAKPOINTS; i++) {
+        if (!dbg->breakpoints[i].used) {
+            dbg->breakpoints[i] = *bp;
+            dbg->breakpoints[i].used = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static Chip8_cond debug_parse_cond(const char *op) {
+    if (strcmp(op, "==") == 0) return CHIP8_COND_EQ;
+    if (strcmp(op, "!=") == 0) return CHIP8_COND_NE;
+    if (strcmp(op, "<") == 0) return CHIP8_COND_LT;
+    if (strcmp(op, ">") == 0) return CHIP8_COND_GT;
+    return CHIP8_COND_NONE;
+}
+
+/*
+Executes one line of the command protocol. Every command answers with
+"ok" or "error <reason>"; stops are reported asynchronously as "stopped ..."
+or "watch ..." lines.
+
+break <pc> [V<x> ==|!=|<|> <value>]   delete <id>   watch <addr> [len] [r|w|rw]
+unwatch <id>   list   step [n]   next   continue   stop   regs   stack
+display   mem <addr> [len]   dis [addr] [count]   quit
+*/
+void chip8_debug_command(Chip8_debug *dbg, char *line) {
+    Chip8 *chip8 = dbg->chip8;
+    char *args[6] = {0};
+    int argc = 0;
+
+    for (char *tok = strtok(line, " \t\r\n"); tok != NULL && argc < 6; tok = strtok(NULL, " \t\r\n"))
+    args[argc++] = tok;
+    if (argc == 0)
+    return;
+
+    char *cmd = args[0];
+
+    if (strcmp(cmd, "break") == 0 && (argc == 2 || argc == 5)) {
+        Chip8_breakpoint bp = {0};
+        bp.pc = strtoul(args[1], NULL, 0) & 0xFFF;
+        bp.sp = -1;
+        if (argc == 5) {
+            if (args[2][0] != 'V' && args[2][0] != 'v') {
+                debug_out(dbg, "error bad register\n");
+                return;
+            }
+            bp.reg = strtoul(args[2] + 1, NULL, 16) & 0xF;
+            bp.cond = debug_parse_cond(args[3]);
+            bp.value = strtoul(args[4], NULL, 0);
+            if (bp.cond == CHIP8_COND_NONE) {
+                debug_out(dbg, "error bad condition\n");
+                return;
+            }
+        }
+        int id = debug_add_breakpoint(dbg, &bp);
+        if (id < 0) {
+            debug_out(dbg, "error too many breakpoints\n");
+            return;
+        }
+        debug_out(dbg, "ok %d\n", id);
+    }
+    else if (strcmp(cmd, "delete") == 0 && argc == 2) {
+        int id = atoi(args[1]);
+        if (id < 0 || id >= CHIP8_DEBUG_MAX_BREAKPOINTS || !dbg->breakpoints[id].used) {
+            debug_out(dbg, "error no such breakpoint\n");
+            return;
+        }
+        dbg->breakpoints[id].used = false;
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "watch") == 0 && argc >= 2) {
+        Chip8_watchpoint wp = {true, CHIP8_WATCH_R | CHIP8_WATCH_W, 0, 1};
+        wp.addr = strtoul(args[1], NULL, 0) & 0xFFF;
+        if (argc >= 3)
+        wp.len = strtoul(args[2], NULL, 0);
+        if (argc >= 4)
+        wp.mode = (strchr(args[3], 'r') ? CHIP8_WATCH_R : 0) | (strchr(args[3], 'w') ? CHIP8_WATCH_W : 0);
+        /* an empty range or no access mode would never fire */
+        if (wp.len == 0) {
+            debug_out(dbg, "error empty watch range\n");
+            return;
+        }
+        if (wp.mode == 0) {
+            debug_out(dbg, "error watch mode must contain r or w\n");
+            return;
+        }
+
+        int id = -1;
+        for (int i = 0; i < CHIP8_DEBUG_MAX_WATCHPOINTS && id < 0; i++) {
+            if (!dbg->watchpoints[i].used) {
+                dbg->watchpoints[i] = wp;
+                id = i;
+            }
+        }
+        if (id < 0) {
+            debug_out(dbg, "error too many watchpoints\n");
+            return;
+        }
+        debug_out(dbg, "ok %d\n", id);
+    }
+    else if (strcmp(cmd, "unwatch") == 0 && argc == 2) {
+        int id = atoi(args[1]);
+        if (id < 0 || id >= CHIP8_DEBUG_MAX_WATCHPOINTS || !dbg->watchpoints[id].used) {
+            debug_out(dbg, "error no such watchpoint\n");
+            return;
+        }
+        dbg->watchpoints[id].used = false;
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "list") == 0) {
+        debug_list(dbg);
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "step") == 0) {
+        debug_out(dbg, "ok\n");
+        debug_resume(dbg, argc >= 2 ? atoi(args[1]) : 1);
+        return;
+    }
+    else if (strcmp(cmd, "next") == 0) {
+        /* step over a 2NNN call by running to the return address at the
+        current stack depth */
+        debug_out(dbg, "ok\n");
+        if ((MEM_READ(PC) & 0xF0) == 0x20) {
+            Chip8_breakpoint bp = {0};
+            bp.pc = PC + 2;
+            bp.sp = SP;
+            bp.temporary = true;
+            if (debug_add_breakpoint(dbg, &bp) >= 0) {
+                debug_resume(dbg, -1);
+                return;
+            }
+        }
+        debug_resume(dbg, 1);
+        return;
+    }
+    else if (strcmp(cmd, "continue") == 0) {
+        debug_out(dbg, "ok\n");
+        debug_resume(dbg, -1);
+        return;
+    }
+    else if (strcmp(cmd, "stop") == 0) {
+        debug_out(dbg, "ok\n");
+        debug_stop(dbg, "interrupt");
+        return;
+    }
+    else if (strcmp(cmd, "regs") == 0) {
+        debug_print_regs(dbg);
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "stack") == 0) {
+        debug_print_stack(dbg);
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "display") == 0) {
+        debug_print_display(dbg);
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "mem") == 0 && argc >= 2) {
+        debug_print_mem(dbg, strtoul(args[1], NULL, 0) & 0xFFF, argc >= 3 ? strtoul(args[2], NULL, 0) : 16);
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "dis") == 0) {
+        debug_print_dis(dbg, argc >= 2 ? strtoul(args[1], NULL, 0) & 0xFFF : PC, argc >= 3 ? atoi(args[2]) : 8);
+        debug_out(dbg, "ok\n");
+    }
+    else if (strcmp(cmd, "quit") == 0) {
+        debug_out(dbg, "ok\n");
+        HALT = true;
+    }
+    else {
+        debug_out(dbg, "error unknown command\n");
+        return;
+    }
+
+    debug_rearm(dbg);
+}
+
+/******************************************************************************/
+
+/*
+Creates a debugger for an instance. Commands are read from stdin, or from
+a single client of a unix socket at socket_path when one is given.
+*/
+Chip8_debug *chip8_debug_open(Chip8 *chip8, const char *socket_path) {
+    Chip8_debug *dbg = calloc(1, sizeof(Chip8_debug));
+    if (dbg == NULL)
+    return NULL;
+
+    dbg->chip8 = chip8;
+    dbg->steps = -1;
+    dbg->listen_fd = -1;
+    dbg->in_fd = STDIN_FILENO;
+    dbg->out_fd = STDOUT_FILENO;
+
+    if (socket_path != NULL) {
+        struct sockaddr_un addr = {0};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+        unlink(socket_path);
+
+        dbg->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (dbg->listen_fd < 0 || bind(dbg->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+        || listen(dbg->listen_fd, 1) < 0) {
+            perror(socket_path);
+            if (dbg->listen_fd >= 0)
+            close(dbg->listen_fd);
+            free(dbg);
+            return NULL;
+        }
+        dbg->in_fd = -1;
+        dbg->out_fd = -1;
+        dbg->socket_path = strdup(socket_path);
+    }
+
+    chip8->debug = NULL;
+    return dbg;
+}
+
+void chip8_debug_close(Chip8_debug *dbg) {
+    if (dbg == NULL)
+    return;
+
+    dbg->chip8->debug = NULL;
+    if (dbg->listen_fd >= 0) {
+        if (dbg->in_fd >= 0)
+        close(dbg->in_fd);
+        close(dbg->listen_fd);
+    }
+    if (dbg->socket_path != NULL) {
+        unlink(dbg->socket_path);
+        free(dbg->socket_path);
+    }
+    free(dbg);
+}
+
+/*
+Services the command transport without blocking. While running it only
+looks for input once per frame; while stopped it waits briefly for a
+command instead of spinning.
+*/
+void chip8_debug_poll(Chip8_debug *dbg) {
+    Chip8 *chip8 = dbg->chip8;
+
+    if (!PAUSE && chip8->frames == dbg->last_poll_frame)
+    return;
+    dbg->last_poll_frame = chip8->frames;
+
+    if (dbg->listen_fd >= 0 && dbg->in_fd < 0) {
+        int client = accept(dbg->listen_fd, NULL, NULL);
+        if (client < 0)
+        return;
+        dbg->in_fd = dbg->out_fd = client;
+        dbg->line_len = 0;
+        dbg->line_overflow = false;
+        debug_out(dbg, "chip8 debugger\n");
+    }
+    if (dbg->in_fd < 0)
+    return;
+
+    struct pollfd p = {dbg->in_fd, POLLIN, 0};
+    if (poll(&p, 1, PAUSE ? 10 : 0) <= 0)
+    return;
+
+    char buf[256];
+    ssize_t n = read(dbg->in_fd, buf, sizeof(buf));
+    if (n <= 0) {
+        if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+        /* client gone: sockets wait for the next one, stdin stays closed */
+        if (dbg->listen_fd >= 0) {
+            close(dbg->in_fd);
+            dbg->out_fd = -1;
+        }
+        dbg->in_fd = -1;
+        return;
+    }
+
+    /* an overlong line is discarded up to its newline, so its tail is not
+    taken for the next command */
+    for (ssize_t i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+            dbg->line[dbg->line_len] = '\0';
+            dbg->line_len = 0;
+            if (dbg->line_overflow)
+            debug_out(dbg, "error line too long\n");
+            else
+            chip8_debug_command(dbg, dbg->line);
+            dbg->line_overflow = false;
+        }
+        else if (dbg->line_len == sizeof(dbg->line) - 1) {
+            dbg->line_overflow = true;
+        }
+        else if (!dbg->line_overflow) {
+            dbg->line[dbg->line_len++] = buf[i];
+        }
+    }
+}
+
+#endif /* CHIP8_DEBUG */
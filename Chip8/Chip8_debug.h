@@ -0,0 +1,113 @@
+#ifndef CHIP8_DEBUG_H
+#define CHIP8_DEBUG_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+
+    /*
+    BREAKPOINT/WATCHPOINT DEBUGGER. WHEN THE CORE IS BUILT WITH CHIP8_DEBUG,
+    chip8_step CONSULTS CHIP8_DEBUG_GATE BEFORE EXECUTING AN INSTRUCTION, AND
+    THE MEMORY-ACCESSING OPCODES (FX33, FX55, FX65, DXYN) REPORT THEIR ACCESSES
+    THROUGH CHIP8_WATCH_READ/CHIP8_WATCH_WRITE. chip8_init REPORTS RESETS
+    THROUGH CHIP8_DEBUG_RESET.
+
+    chip8->debug IS ONLY NON-NULL WHILE SOMETHING IS ARMED (A BREAKPOINT, A
+    WATCHPOINT OR A PENDING STEP). chip8_frame TESTS IT ONCE PER FRAME AND
+    WITH NOTHING ARMED RUNS A LOOP WITHOUT THE GATE; WHAT REMAINS IS ONE NULL
+    TEST IN EACH OF THE FOUR MEMORY OPCODES. WITHOUT CHIP8_DEBUG THE HOOKS
+    COMPILE TO NOTHING.
+
+    A STOPPED MACHINE IS SIMPLY A PAUSED ONE: THE DEBUGGER SETS PAUSE, SO TIMERS
+    AND DRAWING FREEZE EXACTLY AS THEY DO WITH THE P KEY.
+    */
+    #ifdef CHIP8_DEBUG
+    #define CHIP8_DEBUG_GATE(chip8) ((chip8)->debug == NULL || chip8_debug_check((chip8)->debug, (chip8)))
+    #define CHIP8_WATCH_READ(chip8, addr, len) \
+    do { if ((chip8)->debug != NULL) chip8_debug_access((chip8)->debug, (chip8), (addr), (len), false); } while (0)
+    #define CHIP8_WATCH_WRITE(chip8, addr, len) \
+    do { if ((chip8)->debug != NULL) chip8_debug_access((chip8)->debug, (chip8), (addr), (len), true); } while (0)
+    #define CHIP8_DEBUG_RESET(chip8) \
+    do { if ((chip8)->debug != NULL) chip8_debug_reset((chip8)->debug, (chip8)); } while (0)
+    #else
+    #define CHIP8_DEBUG_GATE(chip8) (true)
+    #define CHIP8_WATCH_READ(chip8, addr, len) do { } while (0)
+    #define CHIP8_WATCH_WRITE(chip8, addr, len) do { } while (0)
+    #define CHIP8_DEBUG_RESET(chip8) do { } while (0)
+    #endif
+
+    #define CHIP8_DEBUG_MAX_BREAKPOINTS 16
+    #define CHIP8_DEBUG_MAX_WATCHPOINTS 16
+
+    typedef enum {
+        CHIP8_COND_NONE = 0,
+        CHIP8_COND_EQ,
+        CHIP8_COND_NE,
+        CHIP8_COND_LT,
+        CHIP8_COND_GT
+    } Chip8_cond;
+
+    /* PC breakpoint, optionally conditional on "V<reg> <cond> <value>".
+    Temporary breakpoints (used by step-over) only fire at the given stack
+    depth when sp >= 0, and are removed whenever the machine stops. They
+    also stop it when the stack unwinds below sp or chip8_init resets it */
+    typedef struct Chip8_breakpoint_t {
+        bool used;
+        bool temporary;
+        uint16_t pc;
+        int16_t sp;
+        uint8_t reg;
+        Chip8_cond cond;
+        uint8_t value;
+    } Chip8_breakpoint;
+
+    #define CHIP8_WATCH_R 0x1
+    #define CHIP8_WATCH_W 0x2
+
+    typedef struct Chip8_watchpoint_t {
+        bool used;
+        uint8_t mode;
+        uint16_t addr;
+        uint16_t len;
+    } Chip8_watchpoint;
+
+    typedef struct Chip8_debug_t {
+        Chip8 *chip8;
+
+        Chip8_breakpoint breakpoints[CHIP8_DEBUG_MAX_BREAKPOINTS];
+        Chip8_watchpoint watchpoints[CHIP8_DEBUG_MAX_WATCHPOINTS];
+
+        /* instructions left before stopping, -1 when running freely */
+        int32_t steps;
+        /* let the instruction at a breakpoint execute once after resuming */
+        bool resume;
+        uint32_t last_poll_frame;
+
+        /* command transport: stdin/stdout, or a unix socket */
+        int in_fd;
+        int out_fd;
+        int listen_fd;
+        /* removed again by chip8_debug_close */
+        char *socket_path;
+        char line[256];
+        size_t line_len;
+        /* the current line is too long and is skipped up to its newline */
+        bool line_overflow;
+    } Chip8_debug;
+
+    Chip8_debug *chip8_debug_open(Chip8 *chip8, const char *socket_path);
+    void chip8_debug_close(Chip8_debug *dbg);
+    void chip8_debug_poll(Chip8_debug *dbg);
+    void chip8_debug_command(Chip8_debug *dbg, char *line);
+
+    bool chip8_debug_check(Chip8_debug *dbg, Chip8 *chip8);
+    void chip8_debug_access(Chip8_debug *dbg, Chip8 *chip8, uint16_t addr, uint16_t len, bool write);
+    void chip8_debug_reset(Chip8_debug *dbg, Chip8 *chip8);
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_DEBUG_H */
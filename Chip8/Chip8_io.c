@@ -1,10 +1,37 @@
 #include "Chip8_io.h"
+#include "Chip8_latency.h"
+#include "Chip8_metrics.h"
+
+SDL_Event event;
+SDL_Window* window;
+SDL_Renderer* renderer;
+SDL_Texture* texture;
+
+char window_name[1024];
+char window_name_pause[1024];
+
+/* frame pacing state, all times in microseconds */
+static bool vsync;
+static uint64_t frame_period = 16667;
+static uint64_t last_vblank;
+static uint64_t work_start;
+static uint64_t work_estimate = 2000;
+static uint64_t emulated_until;
+
+static Chip8_latency latency;
+
+static uint64_t _now_us(){
+    return SDL_GetPerformanceCounter() * 1000000 / SDL_GetPerformanceFrequency();
+}
 
 /*
 Platform dependent function that initializes a graphics window.
 
 For this implemntation(Unix/Linux Platforms), graphics are handled using SDL.
-This function simply initializes an SDL window instance and paints it black.
+This function initializes an SDL window with a vsync'd renderer and a 64x32
+streaming texture that is scaled up to the window, and paints it black. If
+no vsync'd renderer is available, presentation falls back to an unsynced
+renderer paced by a timer.
 */
 void _window_init(){
 
@@ -20,9 +47,26 @@ void _window_init(){
         return;
     }
 
-    screenSurface = SDL_GetWindowSurface(window);
-    SDL_FillRect(screenSurface, NULL, SDL_MapRGB(screenSurface->format, 0x00, 0x00, 0x00));
-    SDL_UpdateWindowSurface( window );
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    vsync = (renderer != NULL);
+    if (renderer == NULL) {
+        renderer = SDL_CreateRenderer(window, -1, 0);
+    }
+    if (renderer == NULL) {
+        return;
+    }
+
+    SDL_DisplayMode mode;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0) {
+        frame_period = 1000000 / mode.refresh_rate;
+    }
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+    DISPLAY_WIDTH, DISPLAY_HEIGHT);
+
+    SDL_SetRenderDrawColor(renderer, 0x00, 0x00, 0x00, 0xFF);
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
 
 }
 
@@ -32,33 +76,62 @@ Platform dependent function that kills a graphics window.
 In this implementation, this function kills the running SDL wind0w.
 */
 void _window_kill(){
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
     printf("EXITING...\n");
 }
 
 /*
-Platform dependent function that draws the Chip8 graphics
-memory onto a graphics window
-
-In this implementation, an SDL rectangle is drawn onto the SDL window and is filled
-with a green color.
+Converts the Chip8 graphics memory into the streaming texture and presents
+it. With vsync, SDL_RenderPresent returns at the vblank the frame was shown
+on, which is used as the reference point for pacing the next frame.
 */
-void _drawScreen(Chip8 *chip8){
-
-    //black screen
-    SDL_FillRect(screenSurface, NULL, SDL_MapRGB(screenSurface->format, 0x00, 0x00, 0x00));
+static void _present(Chip8 *chip8, Uint32 on, Uint32 off){
+    static Uint32 pixels[DISPLAY_WIDTH * DISPLAY_HEIGHT];
 
     for(uint8_t y = 0; y < 32; y++){
         for(uint8_t x = 0; x < 64; x++){
-            Uint32 color = (PIXELTEST(x, y))? 0x00FF00: 0x000000;
-            SDL_Rect rect = {x * 10, y * 10, 10, 10};
-            SDL_FillRect(screenSurface, &rect, color);
+            pixels[y * DISPLAY_WIDTH + x] = (PIXELTEST(x, y))? on: off;
         }
     }
 
-    SDL_UpdateWindowSurface(window);
+    SDL_UpdateTexture(texture, NULL, pixels, DISPLAY_WIDTH * sizeof(Uint32));
+    SDL_Rect rect = {0, 0, DISPLAY_WIDTH * 10, DISPLAY_HEIGHT * 10};
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, NULL, &rect);
 
+    uint64_t submitted = _now_us();
+    SDL_RenderPresent(renderer);
+
+    /* without vsync, hold the frame until its slot has passed */
+    if(!vsync && last_vblank != 0){
+        uint64_t slot = last_vblank + frame_period;
+        uint64_t now = _now_us();
+        if(now < slot){
+            SDL_Delay((slot - now) / 1000);
+        }
+    }
+
+    uint64_t now = _now_us();
+    if(work_start != 0){
+        work_estimate = (7 * work_estimate + (submitted - work_start)) / 8;
+        work_start = 0;
+    }
+    last_vblank = now;
+
+    chip8_latency_present(&latency, chip8, now);
+}
+
+/*
+Platform dependent function that draws the Chip8 graphics
+memory onto a graphics window
+
+In this implementation, the display is drawn in green on black.
+*/
+void _drawScreen(Chip8 *chip8){
+    _present(chip8, 0xFF00FF00, 0xFF000000);
 }
 
 /*
@@ -66,20 +139,7 @@ Platform dependent function that inverts the graphics window. Used
 to indicate a paused state.
 */
 void _drawScreenInvert(Chip8 *chip8){
-
-    //black screen
-    SDL_FillRect(screenSurface, NULL, SDL_MapRGB(screenSurface->format, 0x00, 0x00, 0x00));
-
-    for(uint8_t y = 0; y < 32; y++){
-        for(uint8_t x = 0; x < 64; x++){
-            Uint32 color = (PIXELTEST(x, y))?  0x000000: 0x00FF00;
-            SDL_Rect rect = {x * 10, y * 10, 10, 10};
-            SDL_FillRect(screenSurface, &rect, color);
-        }
-    }
-
-    SDL_UpdateWindowSurface(window);
-
+    _present(chip8, 0xFF000000, 0xFF00FF00);
 }
 
 /*
@@ -101,54 +161,65 @@ register is set to 1, else, the corresponding bit is set to 0.
 */
 void _getKeystate(Chip8 *chip8){
     const Uint8 *keyboard_state_array = SDL_GetKeyboardState(NULL);
-    SDL_PollEvent(&event);
+    bool keys_changed = false;
 
-    if(event.type == SDL_QUIT){
-        HALT = true;
-        return;
-    }
+    /* drain every pending event, so a frame-paced caller never falls
+    behind the event queue */
+    while(SDL_PollEvent(&event)){
+        if(event.type == SDL_QUIT){
+            HALT = true;
+            return;
+        }
+
+        if(event.type != SDL_KEYDOWN && event.type != SDL_KEYUP){
+            continue;
+        }
 
-    if(event.type == SDL_KEYDOWN || event.type == SDL_KEYUP)
-    {
         if(keyboard_state_array[SDL_SCANCODE_ESCAPE]){
             chip8_init(chip8);
             return;
         }
 
-        if(keyboard_state_array[SDL_SCANCODE_P]){
+        /* the main loop presents the inverted or normal screen, drawing
+        here would present twice in one frame */
+        if(event.type == SDL_KEYDOWN && keyboard_state_array[SDL_SCANCODE_P]){
             PAUSE = !PAUSE;
-
-            if(PAUSE == true){
-                SDL_SetWindowTitle(window, window_name_pause);
-                _drawScreenInvert(chip8);
-            }
-            else{
-                SDL_SetWindowTitle(window, window_name);
-                _drawScreen(chip8);
-            }
+            SDL_SetWindowTitle(window, PAUSE ? window_name_pause : window_name);
             return;
         }
 
-        (keyboard_state_array[SDL_SCANCODE_1])? KEYSET(0x01) : KEYRESET(0x01);
-        (keyboard_state_array[SDL_SCANCODE_2])? KEYSET(0x02) : KEYRESET(0x02);
-        (keyboard_state_array[SDL_SCANCODE_3])? KEYSET(0x03) : KEYRESET(0x03);
-        (keyboard_state_array[SDL_SCANCODE_4])? KEYSET(0x0C) : KEYRESET(0x0C);
+        keys_changed = true;
+    }
+
+    if(!keys_changed){
+        return;
+    }
+
+    uint16_t keypad = KEYPAD;
 
-        (keyboard_state_array[SDL_SCANCODE_Q])? KEYSET(0x04) : KEYRESET(0x04);
-        (keyboard_state_array[SDL_SCANCODE_W])? KEYSET(0x05) : KEYRESET(0x05);
-        (keyboard_state_array[SDL_SCANCODE_E])? KEYSET(0x06) : KEYRESET(0x06);
-        (keyboard_state_array[SDL_SCANCODE_R])? KEYSET(0x0D) : KEYRESET(0x0D);
+    (keyboard_state_array[SDL_SCANCODE_1])? KEYSET(0x01) : KEYRESET(0x01);
+    (keyboard_state_array[SDL_SCANCODE_2])? KEYSET(0x02) : KEYRESET(0x02);
+    (keyboard_state_array[SDL_SCANCODE_3])? KEYSET(0x03) : KEYRESET(0x03);
+    (keyboard_state_array[SDL_SCANCODE_4])? KEYSET(0x0C) : KEYRESET(0x0C);
 
-        (keyboard_state_array[SDL_SCANCODE_A])? KEYSET(0x07) : KEYRESET(0x07);
-        (keyboard_state_array[SDL_SCANCODE_S])? KEYSET(0x08) : KEYRESET(0x08);
-        (keyboard_state_array[SDL_SCANCODE_D])? KEYSET(0x09) : KEYRESET(0x09);
-        (keyboard_state_array[SDL_SCANCODE_F])? KEYSET(0x0E) : KEYRESET(0x0E);
+    (keyboard_state_array[SDL_SCANCODE_Q])? KEYSET(0x04) : KEYRESET(0x04);
+    (keyboard_state_array[SDL_SCANCODE_W])? KEYSET(0x05) : KEYRESET(0x05);
+    (keyboard_state_array[SDL_SCANCODE_E])? KEYSET(0x06) : KEYRESET(0x06);
+    (keyboard_state_array[SDL_SCANCODE_R])? KEYSET(0x0D) : KEYRESET(0x0D);
 
-        (keyboard_state_array[SDL_SCANCODE_Z])? KEYSET(0x0A) : KEYRESET(0x0A);
-        (keyboard_state_array[SDL_SCANCODE_X])? KEYSET(0x00) : KEYRESET(0x00);;
-        (keyboard_state_array[SDL_SCANCODE_C])? KEYSET(0x0B) : KEYRESET(0x0B);
-        (keyboard_state_array[SDL_SCANCODE_V])? KEYSET(0x0F) : KEYRESET(0x0F);
+    (keyboard_state_array[SDL_SCANCODE_A])? KEYSET(0x07) : KEYRESET(0x07);
+    (keyboard_state_array[SDL_SCANCODE_S])? KEYSET(0x08) : KEYRESET(0x08);
+    (keyboard_state_array[SDL_SCANCODE_D])? KEYSET(0x09) : KEYRESET(0x09);
+    (keyboard_state_array[SDL_SCANCODE_F])? KEYSET(0x0E) : KEYRESET(0x0E);
 
+    (keyboard_state_array[SDL_SCANCODE_Z])? KEYSET(0x0A) : KEYRESET(0x0A);
+    (keyboard_state_array[SDL_SCANCODE_X])? KEYSET(0x00) : KEYRESET(0x00);
+    (keyboard_state_array[SDL_SCANCODE_C])? KEYSET(0x0B) : KEYRESET(0x0B);
+    (keyboard_state_array[SDL_SCANCODE_V])? KEYSET(0x0F) : KEYRESET(0x0F);
+
+    if(KEYPAD != keypad){
+        chip8_latency_key(&latency, chip8, keypad, _now_us());
+        CHIP8_METRICS_ADD(chip8, input_events, 1);
     }
 
 }
@@ -161,7 +232,7 @@ In this implementation, this is handled through SDL's SDL_GetTicks()
 function.
 */
 uint32_t _get_tick(){
-    SDL_GetTicks();
+    return SDL_GetTicks();
 }
 
 /*
@@ -172,6 +243,49 @@ void _beep(){
     // printf("beep\n");
 }
 
+/*
+Schedules the next frame so that emulation and rendering finish just
+before the vblank it will be shown on. Sleeps until that point, leaving
+room for the measured cost of a frame plus a safety margin, so input
+polled right after this returns is as fresh as possible.
+
+Returns the number of 60Hz emulation frames that are due, which keeps game
+speed independent of the display's refresh rate.
+*/
+uint16_t _frame_wait(){
+    if(last_vblank != 0){
+        uint64_t deadline = last_vblank + frame_period;
+        uint64_t start = deadline - work_estimate - FRAME_MARGIN_US;
+        uint64_t now = _now_us();
+        if(now < start){
+            SDL_Delay((start - now) / 1000);
+        }
+    }
+
+    uint64_t now = _now_us();
+    work_start = now;
+
+    /* catch up at most a few frames, e.g. after the window was dragged */
+    if(emulated_until == 0 || now - emulated_until > 4 * EMULATION_PERIOD_US){
+        emulated_until = now - EMULATION_PERIOD_US;
+    }
+
+    uint16_t due = 0;
+    while(emulated_until + EMULATION_PERIOD_US <= now + frame_period / 2){
+        emulated_until += EMULATION_PERIOD_US;
+        due++;
+    }
+    return due;
+}
+
+/*
+Prints the frame-time and input-to-photon latency histograms gathered
+while presenting.
+*/
+void _print_latency_report(){
+    chip8_latency_report(&latency, stdout);
+}
+
 /***********************************************************************************/
 
 /*
@@ -15,13 +15,12 @@ Header file that holds b
 static const int SCREEN_WIDTH = 650;
 static const int SCREEN_HEIGHT = 330;
 
-SDL_Event event;
-SDL_Window* window;
-SDL_Surface* screenSurface;
+/* time reserved between finishing a frame and the vblank it targets */
+static const uint32_t FRAME_MARGIN_US = 2000;
+/* the Chip8 itself always runs at 60 frames per second */
+static const uint32_t EMULATION_PERIOD_US = 16667;
 
-char *rom_name;
-char window_name[1024];
-char window_name_pause[1024];
+extern char *rom_name;
 
 /******************************************************************************/
 //CORE PLATFORM DEFINITIONS. USER *MUST* IMPLEMENT THESE ACCORDING TO THE PLATFORM
@@ -36,6 +35,13 @@ void _getKeystate(Chip8 *chip8);
 uint32_t _get_tick();
 void _beep();
 
+/******************************************************************************/
+/*****************************  FRAME PACING  *********************************/
+/******************************************************************************/
+
+uint16_t _frame_wait();
+void _print_latency_report();
+
 /******************************************************************************/
 /********************  ADDITIONAL HELPER FUNCTIONS ****************************/
 /******************************************************************************/
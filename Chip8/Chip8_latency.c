@@ -0,0 +1,112 @@
+#include "Chip8_latency.h"
+#include <string.h>
+
+static void latency_add(uint32_t hist[], uint32_t *count, uint64_t us) {
+    uint64_t bucket = us / CHIP8_LATENCY_BUCKET_US;
+    if (bucket >= CHIP8_LATENCY_BUCKETS)
+    bucket = CHIP8_LATENCY_BUCKETS - 1;
+
+    hist[bucket]++;
+    (*count)++;
+}
+
+/*
+Called by the frontend whenever it changes the keypad register, with the
+keypad as it was before the change. Only the oldest unreflected event is
+tracked, so a burst of key changes measures from its first event.
+*/
+void chip8_latency_key(Chip8_latency *lat, const Chip8 *chip8, uint16_t keypad_before, uint64_t now_us) {
+    if (lat->pending)
+    return;
+
+    lat->pending = true;
+    lat->key_time = now_us;
+    lat->frames_waiting = 0;
+    chip8_snapshot(chip8, &lat->without_key);
+    lat->without_key.keypad = keypad_before;
+}
+
+/*
+Called by the frontend right after a frame has been presented, with the
+instance that was shown. The copy without the key is first run up to the
+same frame.
+*/
+void chip8_latency_present(Chip8_latency *lat, const Chip8 *chip8, uint64_t now_us) {
+    if (lat->last_present != 0)
+    latency_add(lat->frame_hist, &lat->frame_count, now_us - lat->last_present);
+    lat->last_present = now_us;
+
+    if (!lat->pending)
+    return;
+
+    /* the machine was reset since the event */
+    if (lat->without_key.frames > chip8->frames) {
+        lat->discarded++;
+        lat->pending = false;
+        return;
+    }
+
+    void (*beep)() = chip8_beep;
+    chip8_beep = NULL;
+    while (lat->without_key.frames < chip8->frames && !lat->without_key.halt)
+    chip8_frame(&lat->without_key, CHIP8_CYCLES_PER_FRAME);
+    chip8_beep = beep;
+
+    if (memcmp(lat->without_key.display, chip8->display, sizeof(lat->without_key.display)) != 0) {
+        latency_add(lat->latency_hist, &lat->latency_count, now_us - lat->key_time);
+        lat->pending = false;
+    }
+    else if (++lat->frames_waiting > CHIP8_LATENCY_TIMEOUT) {
+        lat->discarded++;
+        lat->pending = false;
+    }
+}
+
+/* Returns the upper edge, in microseconds, of the bucket holding the p-th
+percentile (0 < p <= 1) */
+uint64_t chip8_latency_percentile(const uint32_t hist[], uint32_t count, double p) {
+    uint64_t rank = (uint64_t) (p * count + 0.5);
+    uint64_t seen = 0;
+
+    if (count == 0)
+    return 0;
+    if (rank == 0)
+    rank = 1;
+    for (uint32_t i = 0; i < CHIP8_LATENCY_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= rank)
+        return (uint64_t) (i + 1) * CHIP8_LATENCY_BUCKET_US;
+    }
+    return (uint64_t) CHIP8_LATENCY_BUCKETS * CHIP8_LATENCY_BUCKET_US;
+}
+
+static void latency_print_hist(const uint32_t hist[], FILE *fp) {
+    uint32_t max = 0;
+    for (uint32_t i = 0; i < CHIP8_LATENCY_BUCKETS; i++)
+    if (hist[i] > max)
+    max = hist[i];
+
+    for (uint32_t i = 0; i < CHIP8_LATENCY_BUCKETS; i++) {
+        if (hist[i] == 0)
+        continue;
+        fprintf(fp, "  %7.2f ms %8u ", (double) i * CHIP8_LATENCY_BUCKET_US / 1000.0, hist[i]);
+        for (uint32_t bar = 0; bar < 40 * hist[i] / max; bar++)
+        fputc('#', fp);
+        fputc('\n', fp);
+    }
+}
+
+void chip8_latency_report(const Chip8_latency *lat, FILE *fp) {
+    fprintf(fp, "frame time: %u frames, p50 %.2f ms, p99 %.2f ms\n", lat->frame_count,
+    chip8_latency_percentile(lat->frame_hist, lat->frame_count, 0.50) / 1000.0,
+    chip8_latency_percentile(lat->frame_hist, lat->frame_count, 0.99) / 1000.0);
+    if (lat->frame_count > 0)
+    latency_print_hist(lat->frame_hist, fp);
+
+    fprintf(fp, "input latency: %u events (%u without visible effect), p50 %.2f ms, p99 %.2f ms\n",
+    lat->latency_count, lat->discarded,
+    chip8_latency_percentile(lat->latency_hist, lat->latency_count, 0.50) / 1000.0,
+    chip8_latency_percentile(lat->latency_hist, lat->latency_count, 0.99) / 1000.0);
+    if (lat->latency_count > 0)
+    latency_print_hist(lat->latency_hist, fp);
+}
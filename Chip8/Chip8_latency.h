@@ -0,0 +1,54 @@
+#ifndef CHIP8_LATENCY_H
+#define CHIP8_LATENCY_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+
+    /*
+    INPUT-TO-PHOTON LATENCY AND FRAME-TIME INSTRUMENTATION. THE FRONTEND
+    REPORTS EACH KEYPAD CHANGE AND EACH PRESENTED FRAME, WITH MICROSECOND
+    TIMESTAMPS FROM ITS OWN CLOCK. AT A KEY EVENT THE MACHINE IS COPIED WITH
+    THE KEYPAD AS IT WAS BEFORE THE EVENT, AND THAT COPY IS RUN ALONGSIDE TO
+    EACH PRESENTED FRAME. THE EVENT IS CONSIDERED REFLECTED BY THE FIRST
+    PRESENTED FRAME WHOSE DISPLAY DIFFERS FROM THE COPY'S, SO A ROM THAT
+    ANIMATES ON ITS OWN DOES NOT COUNT ITS NEXT ANIMATION FRAME AS THE
+    RESPONSE. EVENTS THAT PRODUCE NO VISIBLE CHANGE WITHIN
+    CHIP8_LATENCY_TIMEOUT FRAMES ARE DISCARDED.
+
+    BOTH HISTOGRAMS USE CHIP8_LATENCY_BUCKET_US WIDE BUCKETS; THE LAST BUCKET
+    COLLECTS EVERYTHING ABOVE THE RANGE.
+    */
+    #define CHIP8_LATENCY_BUCKET_US 250
+    #define CHIP8_LATENCY_BUCKETS 800
+    #define CHIP8_LATENCY_TIMEOUT 120
+
+    typedef struct Chip8_latency_t {
+        /* oldest key event not yet reflected on screen */
+        bool pending;
+        uint64_t key_time;
+        uint32_t frames_waiting;
+        /* the machine as it would have run without the event */
+        Chip8 without_key;
+
+        uint64_t last_present;
+
+        uint32_t latency_hist[CHIP8_LATENCY_BUCKETS];
+        uint32_t frame_hist[CHIP8_LATENCY_BUCKETS];
+        uint32_t latency_count;
+        uint32_t frame_count;
+        uint32_t discarded;
+    } Chip8_latency;
+
+    void chip8_latency_key(Chip8_latency *lat, const Chip8 *chip8, uint16_t keypad_before, uint64_t now_us);
+    void chip8_latency_present(Chip8_latency *lat, const Chip8 *chip8, uint64_t now_us);
+    uint64_t chip8_latency_percentile(const uint32_t hist[], uint32_t count, double p);
+    void chip8_latency_report(const Chip8_latency *lat, FILE *fp);
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_LATENCY_H */
@@ -0,0 +1,309 @@
+#include "Chip8_metrics.h"
+
+#ifdef CHIP8_METRICS
+
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+/* every attached instance, guarded by registry_lock. Only attach, detach
+and the exporter take the lock, never the emulation loop */
+static Chip8_metrics *registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t exporter;
+static _Atomic bool exporter_running;
+static char export_path[1024];
+static int listen_fd = -1;
+static uint32_t export_interval_ms;
+
+static uint64_t metrics_now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Copies a label value with \, " and newline escaped as the text format
+requires. An escape is never cut in half by truncation */
+static void metrics_escape_label(char *out, size_t size, const char *value) {
+    size_t len = 0;
+
+    for (; *value != '\0'; value++) {
+        const char *esc = *value == '\\' ? "\\\\" : *value == '"' ? "\\\"" : *value == '\n' ? "\\n" : NULL;
+        size_t n = esc != NULL ? 2 : 1;
+        if (len + n >= size)
+        break;
+        if (esc != NULL)
+        memcpy(out + len, esc, 2);
+        else
+        out[len] = *value;
+        len += n;
+    }
+    out[len] = '\0';
+}
+
+/*
+Allocates counters for an instance and registers them with the exporter.
+name becomes the instance label of every series.
+*/
+Chip8_metrics *chip8_metrics_attach(Chip8 *chip8, const char *name) {
+    Chip8_metrics *metrics = aligned_alloc(64, sizeof(Chip8_metrics));
+    if (metrics == NULL)
+    return NULL;
+
+    memset(metrics, 0, sizeof(Chip8_metrics));
+    metrics_escape_label(metrics->name, sizeof(metrics->name), name != NULL ? name : "chip8");
+    metrics->start_us = metrics_now_us();
+    metrics->last_us = metrics->start_us;
+
+    pthread_mutex_lock(&registry_lock);
+    metrics->next = registry;
+    registry = metrics;
+    pthread_mutex_unlock(&registry_lock);
+
+    chip8->metrics = metrics;
+    return metrics;
+}
+
+void chip8_metrics_detach(Chip8 *chip8) {
+    Chip8_metrics *metrics = chip8->metrics;
+    if (metrics == NULL)
+    return;
+
+    chip8->metrics = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    for (Chip8_metrics **p = &registry; *p != NULL; p = &(*p)->next) {
+        if (*p == metrics) {
+            *p = metrics->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    free(metrics);
+}
+
+static uint64_t metrics_load(_Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/* Writes one metric family: its HELP and TYPE lines, then a sample per
+instance */
+#define METRICS_FAMILY(fp, family, type, help, fmt, expr) \
+do { \
+    fprintf((fp), "# HELP " family " " help "\n# TYPE " family " " type "\n"); \
+    for (Chip8_metrics *m = registry; m != NULL; m = m->next) \
+    fprintf((fp), family "{instance=\"%s\"} " fmt "\n", m->name, (expr)); \
+} while (0)
+
+/* Recomputes the instructions/sec gauge of every instance over the time
+since the previous update. Only the exporter calls this, once per interval,
+so scrapes cannot shorten each other's window */
+static void metrics_update_rates() {
+    uint64_t now = metrics_now_us();
+
+    pthread_mutex_lock(&registry_lock);
+    for (Chip8_metrics *m = registry; m != NULL; m = m->next) {
+        uint64_t instructions = metrics_load(&m->instructions);
+        if (now > m->last_us) {
+            m->instructions_per_second = (instructions - m->last_instructions) * 1e6 / (now - m->last_us);
+            m->last_instructions = instructions;
+            m->last_us = now;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+/*
+Renders every attached instance in Prometheus text format. The
+instructions/sec gauge covers the exporter's last interval; it stays 0
+until one has passed, or when no exporter runs.
+*/
+void chip8_metrics_write(FILE *fp) {
+    uint64_t now = metrics_now_us();
+
+    pthread_mutex_lock(&registry_lock);
+
+    METRICS_FAMILY(fp, "chip8_instructions_total", "counter", "Instructions executed.",
+    "%llu", (unsigned long long) metrics_load(&m->instructions));
+    METRICS_FAMILY(fp, "chip8_instructions_per_second", "gauge", "Instructions executed per second over the last export interval.",
+    "%.1f", m->instructions_per_second);
+    METRICS_FAMILY(fp, "chip8_frames_emulated_total", "counter", "60Hz timer ticks emulated.",
+    "%llu", (unsigned long long) metrics_load(&m->frames_emulated));
+    METRICS_FAMILY(fp, "chip8_frames_presented_total", "counter", "Frames presented by the frontend.",
+    "%llu", (unsigned long long) metrics_load(&m->frames_presented));
+    METRICS_FAMILY(fp, "chip8_frames_paused_total", "counter", "Frames that found the machine paused.",
+    "%llu", (unsigned long long) metrics_load(&m->frames_paused));
+    /* positive when emulated time runs ahead of wall-clock time. Paused
+    frames count as on time, so the drift picks up where it left off when
+    the machine resumes */
+    METRICS_FAMILY(fp, "chip8_timer_drift_ticks", "gauge", "Timer ticks emulated or paused minus ticks due at 60Hz since attach.",
+    "%.1f", (double) (metrics_load(&m->frames_emulated) + metrics_load(&m->frames_paused))
+    - (now - m->start_us) * 60.0 / 1e6);
+    METRICS_FAMILY(fp, "chip8_key_wait_seconds_total", "counter", "Emulated time spent waiting for a key in FX0A.",
+    "%.3f", metrics_load(&m->key_wait_frames) / 60.0);
+    METRICS_FAMILY(fp, "chip8_draws_total", "counter", "DXYN sprite draws.",
+    "%llu", (unsigned long long) metrics_load(&m->draws));
+    METRICS_FAMILY(fp, "chip8_collisions_total", "counter", "DXYN draws that set VF.",
+    "%llu", (unsigned long long) metrics_load(&m->collisions));
+    METRICS_FAMILY(fp, "chip8_input_events_total", "counter", "Keypad changes processed.",
+    "%llu", (unsigned long long) metrics_load(&m->input_events));
+
+    pthread_mutex_unlock(&registry_lock);
+}
+
+/* Rewrites the export file through a rename, so readers never see a
+partial scrape */
+static void metrics_write_file() {
+    char tmp[sizeof(export_path) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", export_path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL)
+    return;
+    chip8_metrics_write(fp);
+    if (fclose(fp) == 0)
+    rename(tmp, export_path);
+}
+
+/* The scrape is rendered to memory first and sent without SIGPIPE, so a
+client hanging up early cannot take the emulator down. A client that has
+not taken the whole scrape after CHIP8_METRICS_SEND_TIMEOUT_MS is dropped,
+so it holds up neither other scrapers nor the next update */
+static void metrics_serve_client(int client) {
+    struct timeval timeout = {0, CHIP8_METRICS_SEND_TIMEOUT_MS * 1000};
+    uint64_t deadline = metrics_now_us() + CHIP8_METRICS_SEND_TIMEOUT_MS * 1000ULL;
+    char *text = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&text, &len);
+
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (fp != NULL) {
+        chip8_metrics_write(fp);
+        fclose(fp);
+        for (size_t sent = 0; sent < len; ) {
+            ssize_t n = send(client, text + sent, len - sent, MSG_NOSIGNAL);
+            if (n <= 0 || metrics_now_us() >= deadline)
+            break;
+            sent += n;
+        }
+        free(text);
+    }
+    close(client);
+}
+
+/*
+Background exporter. Every interval it updates the rates and, in file
+mode, rewrites the file; in socket mode it answers each connection with a
+scrape and closes it.
+*/
+static void *metrics_exporter(void *arg) {
+    struct timespec idle = {0, 100000000};
+    uint64_t next_update = metrics_now_us() + export_interval_ms * 1000ULL;
+
+    (void) arg;
+    if (listen_fd < 0)
+    metrics_write_file();
+
+    /* wakes at least every 100ms, so chip8_metrics_stop never waits a
+    whole interval */
+    while (atomic_load_explicit(&exporter_running, memory_order_acquire)) {
+        uint64_t now = metrics_now_us();
+        if (now >= next_update) {
+            metrics_update_rates();
+            if (listen_fd < 0)
+            metrics_write_file();
+            next_update = now + export_interval_ms * 1000ULL;
+        }
+
+        if (listen_fd >= 0) {
+            struct pollfd p = {listen_fd, POLLIN, 0};
+            if (poll(&p, 1, 100) > 0) {
+                int client = accept(listen_fd, NULL, NULL);
+                if (client >= 0)
+                metrics_serve_client(client);
+            }
+        }
+        else {
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+Starts exporting. target is either "unix:<path>" for a socket or a file
+path. interval_ms is how often the file is rewritten and the rates
+recomputed; 0 selects CHIP8_METRICS_INTERVAL_MS.
+*/
+bool chip8_metrics_start(const char *target, uint32_t interval_ms) {
+    if (atomic_load(&exporter_running) || target == NULL)
+    return false;
+
+    export_interval_ms = interval_ms ? interval_ms : CHIP8_METRICS_INTERVAL_MS;
+
+    if (strncmp(target, "unix:", 5) == 0) {
+        struct sockaddr_un addr = {0};
+        size_t len = strlen(target + 5);
+        if (len >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "%s: socket path too long\n", target + 5);
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, target + 5, len + 1);
+        memcpy(export_path, target + 5, len + 1);
+        unlink(export_path);
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+        || listen(listen_fd, 4) < 0) {
+            perror(export_path);
+            if (listen_fd >= 0)
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+    }
+    else {
+        snprintf(export_path, sizeof(export_path), "%s", target);
+    }
+
+    atomic_store(&exporter_running, true);
+    if (pthread_create(&exporter, NULL, metrics_exporter, NULL) != 0) {
+        atomic_store(&exporter_running, false);
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(export_path);
+            listen_fd = -1;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+/* Stops the exporter. A file gets one last, final rewrite */
+void chip8_metrics_stop() {
+    if (!atomic_load(&exporter_running))
+    return;
+
+    atomic_store_explicit(&exporter_running, false, memory_order_release);
+    pthread_join(exporter, NULL);
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(export_path);
+        listen_fd = -1;
+    }
+    else {
+        metrics_write_file();
+    }
+}
+
+#endif /* CHIP8_METRICS */
@@ -0,0 +1,92 @@
+#ifndef CHIP8_METRICS_H
+#define CHIP8_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+    #include <stdatomic.h>
+    #include <pthread.h>
+
+    /*
+    RUNTIME METRICS. WHEN THE CORE IS BUILT WITH CHIP8_METRICS, AN INSTANCE
+    WITH chip8->metrics ATTACHED COUNTS EXECUTED INSTRUCTIONS, TIMER TICKS,
+    FRAMES SPENT WAITING IN FX0A, DXYN DRAWS AND COLLISIONS. THE FRONTEND ADDS
+    PRESENTED FRAMES AND INPUT EVENTS THROUGH THE SAME MACRO.
+
+    EVERY COUNTER HAS A SINGLE WRITER, THE THREAD RUNNING THE INSTANCE, SO AN
+    UPDATE IS A RELAXED LOAD AND STORE OF ITS OWN CACHE LINE: NO LOCKED
+    INSTRUCTION, AND NOTHING THE EXPORTER DOES CAN STALL IT. THE EXPORTER ONLY
+    EVER READS THE COUNTERS, FROM A BACKGROUND THREAD, AND RENDERS THEM IN
+    PROMETHEUS TEXT FORMAT EITHER INTO A FILE REWRITTEN EVERY INTERVAL OR TO
+    EACH CLIENT OF A UNIX SOCKET.
+
+    WITHOUT CHIP8_METRICS THE HOOKS EXPAND TO NOTHING.
+    */
+    #ifdef CHIP8_METRICS
+    #define CHIP8_METRICS_ADD(chip8, counter, n) \
+    do { if ((chip8)->metrics != NULL) chip8_metrics_add(&(chip8)->metrics->counter, (n)); } while (0)
+    #define CHIP8_METRICS_KEY_WAIT(chip8) \
+    do { if ((chip8)->metrics != NULL) (chip8)->metrics->key_waiting = true; } while (0)
+    #define CHIP8_METRICS_TICK(chip8) \
+    do { if ((chip8)->metrics != NULL) chip8_metrics_tick((chip8)->metrics); } while (0)
+    #else
+    #define CHIP8_METRICS_ADD(chip8, counter, n) do { } while (0)
+    #define CHIP8_METRICS_KEY_WAIT(chip8) do { } while (0)
+    #define CHIP8_METRICS_TICK(chip8) do { } while (0)
+    #endif
+
+    #define CHIP8_METRICS_NAME_SIZE 64
+    #define CHIP8_METRICS_INTERVAL_MS 1000
+    #define CHIP8_METRICS_SEND_TIMEOUT_MS 100
+
+    typedef struct Chip8_metrics_t {
+        /* written by the emulation thread only */
+        _Atomic uint64_t instructions;
+        _Atomic uint64_t frames_emulated;
+        _Atomic uint64_t frames_presented;
+        /* chip8_frame calls that found the machine paused */
+        _Atomic uint64_t frames_paused;
+        _Atomic uint64_t key_wait_frames;
+        _Atomic uint64_t draws;
+        _Atomic uint64_t collisions;
+        _Atomic uint64_t input_events;
+        /* FX0A re-executed since the last timer tick */
+        bool key_waiting;
+
+        /* exporter side. name is the instance label, already escaped */
+        char name[CHIP8_METRICS_NAME_SIZE] __attribute__((aligned(64)));
+        uint64_t start_us;
+        uint64_t last_us;
+        uint64_t last_instructions;
+        double instructions_per_second;
+        struct Chip8_metrics_t *next;
+    } Chip8_metrics;
+
+    /* Single writer, so a relaxed load/store pair is enough and compiles to
+    a plain add */
+    static inline void chip8_metrics_add(_Atomic uint64_t *counter, uint64_t n) {
+        atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+        memory_order_relaxed);
+    }
+
+    static inline void chip8_metrics_tick(Chip8_metrics *metrics) {
+        chip8_metrics_add(&metrics->frames_emulated, 1);
+        if (metrics->key_waiting) {
+            chip8_metrics_add(&metrics->key_wait_frames, 1);
+            metrics->key_waiting = false;
+        }
+    }
+
+    Chip8_metrics *chip8_metrics_attach(Chip8 *chip8, const char *name);
+    void chip8_metrics_detach(Chip8 *chip8);
+    void chip8_metrics_write(FILE *fp);
+    bool chip8_metrics_start(const char *target, uint32_t interval_ms);
+    void chip8_metrics_stop();
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_METRICS_H */
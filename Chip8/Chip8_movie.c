@@ -0,0 +1,132 @@
+#include "Chip8_movie.h"
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Records the keypad for a frame. Entries must arrive in frame order, and
+unchanged keypad states are not stored */
+void chip8_movie_append(Chip8_movie *movie, uint32_t frame, uint16_t keypad) {
+    uint16_t current = movie->count ? movie->events[movie->count - 1].keypad : 0;
+    if (keypad == current)
+    return;
+
+    if (movie->count == movie->capacity) {
+        movie->capacity = movie->capacity ? movie->capacity * 2 : 64;
+        movie->events = realloc(movie->events, movie->capacity * sizeof(Chip8_movie_event));
+    }
+
+    movie->events[movie->count].frame = frame;
+    movie->events[movie->count].keypad = keypad;
+    movie->count++;
+}
+
+/* Keypad state for a frame: the latest entry at or before it */
+uint16_t chip8_movie_keypad(const Chip8_movie *movie, uint32_t frame) {
+    uint32_t lo = 0, hi = movie->count;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (movie->events[mid].frame <= frame)
+        lo = mid + 1;
+        else
+        hi = mid;
+    }
+    return lo ? movie->events[lo - 1].keypad : 0;
+}
+
+bool chip8_movie_load(Chip8_movie *movie, const char *filename) {
+    FILE *fp = fopen(filename, "r");
+    char line[128];
+
+    memset(movie, 0, sizeof(Chip8_movie));
+    if (fp == NULL)
+    return false;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *p = line + strspn(line, " \t");
+        unsigned long frame, keypad;
+
+        if (*p == '#' || *p == '\n' || *p == '\0')
+        continue;
+        if (strncmp(p, "seed", 4) == 0) {
+            movie->seed = strtoul(p + 4, NULL, 0);
+            continue;
+        }
+        if (sscanf(p, "%lu %lx", &frame, &keypad) != 2) {
+            fclose(fp);
+            chip8_movie_free(movie);
+            return false;
+        }
+        chip8_movie_append(movie, frame, keypad);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+bool chip8_movie_save(const Chip8_movie *movie, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+    return false;
+
+    fprintf(fp, "# chip8 movie\nseed 0x%08X\n", movie->seed);
+    for (uint32_t i = 0; i < movie->count; i++)
+    fprintf(fp, "%u %04X\n", movie->events[i].frame, movie->events[i].keypad);
+
+    return fclose(fp) == 0;
+}
+
+void chip8_movie_free(Chip8_movie *movie) {
+    free(movie->events);
+    memset(movie, 0, sizeof(Chip8_movie));
+}
+
+static int movie_compare_names(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Lists the roms in a directory, sorted by name, skipping dot files. Returns
+the number of roms, or -1 when the directory cannot be read */
+int chip8_movie_list_roms(const char *rom_dir, char ***names) {
+    DIR *d = opendir(rom_dir);
+    struct dirent *dir;
+    int count = 0, capacity = 0;
+
+    *names = NULL;
+    if (d == NULL)
+    return -1;
+
+    while ((dir = readdir(d)) != NULL) {
+        if (dir->d_name[0] == '.')
+        continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            *names = realloc(*names, capacity * sizeof(char *));
+        }
+        (*names)[count++] = strdup(dir->d_name);
+    }
+    closedir(d);
+
+    qsort(*names, count, sizeof(char *), movie_compare_names);
+    return count;
+}
+
+void chip8_movie_free_roms(char **names, int count) {
+    for (int i = 0; i < count; i++)
+    free(names[i]);
+    free(names);
+}
+
+/*
+Loads the input for a rom: <input_dir>/<rom>.movie, or
+<input_dir>/default.movie when the rom has none. A movie that exists but
+does not parse fails, rather than silently running the rom with different
+input. The file tried is left in path either way.
+*/
+bool chip8_movie_load_for_rom(Chip8_movie *movie, const char *input_dir, const char *rom, char *path,
+size_t size) {
+    snprintf(path, size, "%s/%s.movie", input_dir, rom);
+    if (access(path, F_OK) != 0)
+    snprintf(path, size, "%s/default.movie", input_dir);
+    return chip8_movie_load(movie, path);
+}
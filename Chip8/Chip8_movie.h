@@ -0,0 +1,53 @@
+#ifndef CHIP8_MOVIE_H
+#define CHIP8_MOVIE_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+
+    /*
+    INPUT MOVIES. A MOVIE IS THE KEYPAD STATE OVER TIME, STORED AS THE LIST OF
+    FRAMES AT WHICH IT CHANGES, PLUS THE RNG SEED THE RUN STARTED FROM. THE
+    TEXT FORMAT IS ONE DIRECTIVE PER LINE:
+
+        # comment
+        seed 0x1234
+        <frame> <keypad bitmask in hex>
+
+    THE KEYPAD IS HELD FROM ITS FRAME UNTIL THE NEXT ENTRY; BEFORE THE FIRST
+    ENTRY NO KEY IS DOWN. FRAMES COUNT chip8_frame CALLS FROM ZERO.
+
+    THE REPLAY SUITES (tests/golden.c, tests/metrics.c) RUN EVERY ROM IN A
+    DIRECTORY, EACH WITH <input-dir>/<rom>.movie OR, WHEN THE ROM HAS NONE,
+    <input-dir>/default.movie.
+    */
+    typedef struct Chip8_movie_event_t {
+        uint32_t frame;
+        uint16_t keypad;
+    } Chip8_movie_event;
+
+    typedef struct Chip8_movie_t {
+        uint32_t seed;
+        uint32_t count;
+        uint32_t capacity;
+        Chip8_movie_event *events;
+    } Chip8_movie;
+
+    bool chip8_movie_load(Chip8_movie *movie, const char *filename);
+    bool chip8_movie_save(const Chip8_movie *movie, const char *filename);
+    void chip8_movie_append(Chip8_movie *movie, uint32_t frame, uint16_t keypad);
+    uint16_t chip8_movie_keypad(const Chip8_movie *movie, uint32_t frame);
+    void chip8_movie_free(Chip8_movie *movie);
+
+    int chip8_movie_list_roms(const char *rom_dir, char ***names);
+    void chip8_movie_free_roms(char **names, int count);
+    bool chip8_movie_load_for_rom(Chip8_movie *movie, const char *input_dir, const char *rom, char *path,
+    size_t size);
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_MOVIE_H */
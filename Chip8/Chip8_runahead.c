@@ -0,0 +1,66 @@
+#include "Chip8_runahead.h"
+#include <string.h>
+
+void chip8_runahead_init(Chip8_runahead *ra, uint8_t frames, Chip8_runahead_mode mode) {
+    memset(ra, 0, sizeof(Chip8_runahead));
+    ra->frames = frames;
+    ra->mode = mode;
+}
+
+/*
+Runs one real frame on chip8 with its current keypad, then the configured
+number of speculative frames, and returns the instance whose display should
+be presented. With run-ahead disabled that is chip8 itself.
+*/
+const Chip8 *chip8_runahead_frame(Chip8_runahead *ra, Chip8 *chip8, uint16_t cycles) {
+    chip8_frame(chip8, cycles);
+
+    if (ra->frames == 0 || chip8->halt || chip8->pause)
+    return chip8;
+
+    /* speculative frames must not make noise */
+    void (*beep)() = chip8_beep;
+    chip8_beep = NULL;
+
+    if (ra->mode == CHIP8_RUNAHEAD_INSTANCE) {
+        chip8_snapshot(chip8, &ra->ahead);
+        for (uint8_t i = 0; i < ra->frames; i++)
+        chip8_frame(&ra->ahead, cycles);
+    }
+    else {
+        /* keep the trace, debugger and metrics out of the speculative
+        frames */
+        #ifdef CHIP8_TRACE
+        struct Chip8_trace_t *trace = chip8->trace;
+        chip8->trace = NULL;
+        #endif
+        #ifdef CHIP8_DEBUG
+        struct Chip8_debug_t *debug = chip8->debug;
+        chip8->debug = NULL;
+        #endif
+        #ifdef CHIP8_METRICS
+        struct Chip8_metrics_t *metrics = chip8->metrics;
+        chip8->metrics = NULL;
+        #endif
+
+        chip8_snapshot(chip8, &ra->saved);
+        for (uint8_t i = 0; i < ra->frames; i++)
+        chip8_frame(chip8, cycles);
+        memcpy(ra->ahead.display, chip8->display, sizeof(ra->ahead.display));
+        ra->ahead.frames = chip8->frames;
+        chip8_restore(chip8, &ra->saved);
+
+        #ifdef CHIP8_TRACE
+        chip8->trace = trace;
+        #endif
+        #ifdef CHIP8_DEBUG
+        chip8->debug = debug;
+        #endif
+        #ifdef CHIP8_METRICS
+        chip8->metrics = metrics;
+        #endif
+    }
+
+    chip8_beep = beep;
+    return &ra->ahead;
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8_RUNAHEAD_H
+#define CHIP8_RUNAHEAD_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+
+    /*
+    RUN-AHEAD. MANY ROMS ONLY SAMPLE THE KEYPAD (EX9E/EXA1) ONCE PER GAME LOOP,
+    SO A KEY PRESS SHOWS UP ONE OR MORE FRAMES AFTER IT WAS POLLED. EVERY HOST
+    FRAME, THE REAL MACHINE RUNS ONE FRAME, THEN A THROWAWAY COPY IS RUN
+    `frames` FURTHER FRAMES WITH THE SAME KEYPAD, AND THAT COPY'S DISPLAY IS
+    WHAT GETS PRESENTED. THE REAL MACHINE NEVER SEES THE SPECULATIVE FRAMES.
+
+    RESTORE MODE SAVES THE MACHINE, RUNS AHEAD IN PLACE AND RESTORES IT (TWO
+    STATE COPIES PER FRAME). INSTANCE MODE RUNS AHEAD ON A SECOND INSTANCE
+    THAT IS RESYNCED FROM THE REAL ONE EACH FRAME (ONE COPY, NO RESTORE).
+    */
+    typedef enum {
+        CHIP8_RUNAHEAD_RESTORE = 0,
+        CHIP8_RUNAHEAD_INSTANCE
+    } Chip8_runahead_mode;
+
+    typedef struct Chip8_runahead_t {
+        uint8_t frames;
+        Chip8_runahead_mode mode;
+
+        /* restore mode: saved real state. instance mode: unused */
+        Chip8 saved;
+        /* what gets presented: the second instance, or in restore mode a
+        copy of the run-ahead display and frame count */
+        Chip8 ahead;
+    } Chip8_runahead;
+
+    void chip8_runahead_init(Chip8_runahead *ra, uint8_t frames, Chip8_runahead_mode mode);
+    const Chip8 *chip8_runahead_frame(Chip8_runahead *ra, Chip8 *chip8, uint16_t cycles);
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_RUNAHEAD_H */
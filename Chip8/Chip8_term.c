@@ -0,0 +1,389 @@
+#include "Chip8_term.h"
+#include "Chip8_metrics.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TERM_MAX_ROWS (DISPLAY_HEIGHT / 2)
+#define TERM_MAX_COLS DISPLAY_WIDTH
+
+static Chip8_term_glyphs term_glyphs;
+static uint8_t term_rows;
+static uint8_t term_cols;
+static const char *term_title;
+
+/* cell values currently on the terminal, 0xFFFF when unknown */
+static uint16_t term_cells[TERM_MAX_ROWS][TERM_MAX_COLS];
+/* cursor position after the last write, -1 when unknown */
+static int term_row = -1;
+static int term_col = -1;
+static bool term_paused;
+
+/* worst case: every cell moved to and drawn, plus the status line */
+static char term_out[TERM_MAX_ROWS * TERM_MAX_COLS * 16 + 256];
+static size_t term_len;
+
+static struct termios term_saved;
+static bool term_raw;
+
+/* per key, plus the pause key last, the tick until which it is held
+down */
+#define TERM_PAUSE_KEY 16
+static uint32_t term_key_until[17];
+static uint32_t term_delay_ms;
+
+static uint64_t term_frames;
+static uint64_t term_bytes;
+static uint64_t term_max_bytes;
+static uint64_t term_next_frame_us;
+
+/* keyboard layout, same as the SDL frontend: 1234/qwer/asdf/zxcv */
+static const char term_keymap[16] = {
+    'x', '1', '2', '3', 'q', 'w', 'e', 'a', 's', 'd', 'z', 'c', '4', 'r', 'f', 'v'
+};
+
+static uint64_t _term_now_us(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+Registers a byte for a key. A byte for a key that is still held is its
+autorepeat, which holds it only briefly. Returns true for a new press.
+*/
+static bool term_press(int key, uint32_t now){
+    bool held = (int32_t) (term_key_until[key] - now) > 0;
+
+    term_key_until[key] = now + (held ? CHIP8_TERM_HOLD_MS : term_delay_ms);
+    return !held;
+}
+
+static void term_put(const char *s, size_t len){
+    memcpy(term_out + term_len, s, len);
+    term_len += len;
+}
+
+static void term_puts(const char *s){
+    term_put(s, strlen(s));
+}
+
+/* Writes out the frame, waiting for a slow link to drain rather than
+dropping the rest. On a hard error nothing on the terminal is known any
+more, so the next frame redraws every cell */
+static void term_flush(){
+    size_t done = 0;
+    while(done < term_len){
+        ssize_t n = write(STDOUT_FILENO, term_out + done, term_len - done);
+        if(n > 0){
+            done += n;
+        }
+        else if(n < 0 && errno == EINTR){
+            continue;
+        }
+        else if(n < 0 && errno == EAGAIN){
+            struct pollfd out = {STDOUT_FILENO, POLLOUT, 0};
+            poll(&out, 1, -1);
+        }
+        else{
+            memset(term_cells, 0xFF, sizeof(term_cells));
+            term_row = term_col = -1;
+            break;
+        }
+    }
+    term_len = 0;
+}
+
+/* Cell value for the given display, bit i set for each lit pixel */
+static uint16_t term_cell(const Chip8 *chip8, int row, int col){
+    uint16_t cell = 0;
+
+    if(term_glyphs == CHIP8_TERM_BRAILLE){
+        /* braille dot numbering: 1-3 and 7 down the left column, 4-6 and 8
+        down the right */
+        static const uint8_t dots[4][2] = {{0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}};
+        for(int dy = 0; dy < 4; dy++){
+            for(int dx = 0; dx < 2; dx++){
+                if(PIXELTEST(col * 2 + dx, row * 4 + dy)){
+                    cell |= dots[dy][dx];
+                }
+            }
+        }
+    }
+    else{
+        if(PIXELTEST(col, row * 2)){
+            cell |= 1;
+        }
+        if(PIXELTEST(col, row * 2 + 1)){
+            cell |= 2;
+        }
+    }
+    return cell;
+}
+
+/* UTF-8 glyph for a cell value; returns its length */
+static size_t term_glyph(uint16_t cell, char *buf){
+    if(cell == 0){
+        buf[0] = ' ';
+        return 1;
+    }
+    if(term_glyphs == CHIP8_TERM_BRAILLE){
+        /* U+2800 + dots */
+        buf[0] = 0xE2;
+        buf[1] = 0xA0 | (cell >> 6);
+        buf[2] = 0x80 | (cell & 0x3F);
+        return 3;
+    }
+
+    static const char *blocks[4] = {" ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88"};
+    memcpy(buf, blocks[cell], 3);
+    return 3;
+}
+
+/*
+Moves the cursor to a cell with the cheapest sequence: nothing when it is
+already there, redrawing the skipped cells when that is shorter than a
+move, a relative move along the row, or an absolute move
+*/
+static void term_move(int row, int col, const uint16_t next[TERM_MAX_ROWS][TERM_MAX_COLS]){
+    if(row == term_row && col == term_col){
+        return;
+    }
+
+    char seq[32];
+    int len;
+    if(row == term_row && col > term_col){
+        len = sprintf(seq, "\x1b[%dC", col - term_col);
+
+        char glyphs[TERM_MAX_COLS * 3];
+        size_t glen = 0;
+        for(int c = term_col; c < col && glen < (size_t) len; c++){
+            glen += term_glyph(next[row][c], glyphs + glen);
+        }
+        if(glen < (size_t) len){
+            term_put(glyphs, glen);
+            term_col = col;
+            return;
+        }
+    }
+    else{
+        len = sprintf(seq, "\x1b[%d;%dH", row + 1, col + 1);
+    }
+    term_put(seq, len);
+    term_row = row;
+    term_col = col;
+}
+
+static void term_status(){
+    char line[256];
+    int len = snprintf(line, sizeof(line), "\x1b[%d;1H\x1b[2K%s%s", term_rows + 1, term_title,
+    term_paused ? " - PAUSED" : "");
+    term_put(line, len);
+    term_row = -1;
+}
+
+static void term_present(Chip8 *chip8, bool invert){
+    static uint16_t next[TERM_MAX_ROWS][TERM_MAX_COLS];
+    uint16_t mask = term_glyphs == CHIP8_TERM_BRAILLE ? 0xFF : 0x03;
+
+    for(int r = 0; r < term_rows; r++){
+        for(int c = 0; c < term_cols; c++){
+            next[r][c] = term_cell(chip8, r, c) ^ (invert ? mask : 0);
+        }
+    }
+
+    for(int r = 0; r < term_rows; r++){
+        for(int c = 0; c < term_cols; c++){
+            if(next[r][c] == term_cells[r][c]){
+                continue;
+            }
+            char glyph[4];
+            term_move(r, c, (const uint16_t (*)[TERM_MAX_COLS]) next);
+            term_put(glyph, term_glyph(next[r][c], glyph));
+            term_cells[r][c] = next[r][c];
+            term_col++;
+        }
+    }
+
+    if(invert != term_paused){
+        term_paused = invert;
+        term_status();
+    }
+
+    term_frames++;
+    term_bytes += term_len;
+    if(term_len > term_max_bytes){
+        term_max_bytes = term_len;
+    }
+    term_flush();
+}
+
+static void term_restore(){
+    if(!term_raw){
+        return;
+    }
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &term_saved);
+    /* show the cursor, leave the alternate screen */
+    term_puts("\x1b[0m\x1b[?25h\x1b[?1049l");
+    term_flush();
+    term_raw = false;
+}
+
+/*
+Switches the terminal to raw input, where VMIN=0/VTIME=0 make reads
+return at once, and an alternate screen with a hidden cursor. The file
+status flags are left alone: stdin and stdout usually share one open
+file description, so O_NONBLOCK on stdin would also make frame writes
+fail with EAGAIN on a slow link. The terminal is restored by _term_kill, or at exit.
+delay_ms is how long a first key press is held, 0 selects
+CHIP8_TERM_DELAY_MS.
+*/
+void _term_init(Chip8_term_glyphs glyphs, const char *title, uint32_t delay_ms){
+    term_glyphs = glyphs;
+    term_delay_ms = delay_ms ? delay_ms : CHIP8_TERM_DELAY_MS;
+    term_rows = glyphs == CHIP8_TERM_BRAILLE ? DISPLAY_HEIGHT / 4 : DISPLAY_HEIGHT / 2;
+    term_cols = glyphs == CHIP8_TERM_BRAILLE ? DISPLAY_WIDTH / 2 : DISPLAY_WIDTH;
+    term_title = title;
+
+    if(tcgetattr(STDIN_FILENO, &term_saved) == 0){
+        struct termios raw = term_saved;
+        raw.c_iflag &= ~(IXON | ICRNL);
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+        term_raw = true;
+        atexit(term_restore);
+    }
+
+    memset(term_cells, 0xFF, sizeof(term_cells));
+    term_puts("\x1b[?1049h\x1b[?25l\x1b[2J");
+    term_status();
+    term_flush();
+}
+
+void _term_kill(){
+    term_restore();
+    printf("EXITING...\n");
+}
+
+/*
+Draws the changed cells of the display. Lit pixels are drawn in the
+terminal's foreground colour.
+*/
+void _term_drawScreen(Chip8 *chip8){
+    term_present(chip8, false);
+}
+
+/* Draws the display inverted, to indicate a paused state */
+void _term_drawScreenInvert(Chip8 *chip8){
+    term_present(chip8, true);
+}
+
+/*
+Reads every pending byte from stdin. A keypad key is held for the repeat
+delay after its first byte and CHIP8_TERM_HOLD_MS after each repeat; p
+toggles pause on a new press only, a lone Esc resets the machine, and
+Ctrl-C quits.
+*/
+void _term_getKeystate(Chip8 *chip8){
+    char buf[256];
+    ssize_t n;
+    uint32_t now = _term_get_tick();
+    struct pollfd in = {STDIN_FILENO, POLLIN, 0};
+
+    /* raw mode reads never block; the poll keeps a stdin that is not a
+    terminal from blocking either */
+    while(poll(&in, 1, 0) > 0 && (n = read(STDIN_FILENO, buf, sizeof(buf))) > 0){
+        for(ssize_t i = 0; i < n; i++){
+            char ch = buf[i];
+
+            if(ch == 0x03){
+                HALT = true;
+                return;
+            }
+            if(ch == 0x1b){
+                if(i + 1 == n){
+                    chip8_init(chip8);
+                    return;
+                }
+                /* skip escape sequences (arrows, function keys): ESC, an
+                optional [ or O, parameters, then a final byte */
+                i++;
+                if(buf[i] == '[' || buf[i] == 'O'){
+                    i++;
+                }
+                while(i < n && (buf[i] < 0x40 || buf[i] > 0x7E)){
+                    i++;
+                }
+                continue;
+            }
+            if(ch == 'p' || ch == 'P'){
+                if(term_press(TERM_PAUSE_KEY, now)){
+                    PAUSE = !PAUSE;
+                }
+                continue;
+            }
+            if(ch >= 'A' && ch <= 'Z'){
+                ch += 'a' - 'A';
+            }
+            for(uint8_t k = 0; k < 16; k++){
+                if(term_keymap[k] == ch){
+                    term_press(k, now);
+                }
+            }
+        }
+    }
+
+    uint16_t keypad = KEYPAD;
+    for(uint8_t k = 0; k < 16; k++){
+        ((int32_t) (term_key_until[k] - now) > 0)? KEYSET(k) : KEYRESET(k);
+    }
+    if(KEYPAD != keypad){
+        CHIP8_METRICS_ADD(chip8, input_events, 1);
+    }
+}
+
+uint32_t _term_get_tick(){
+    return _term_now_us() / 1000;
+}
+
+/* Rings the terminal bell */
+void _term_beep(){
+    term_puts("\a");
+}
+
+/*
+Sleeps until the next 60Hz slot. Returns the number of emulation frames
+due, at most a few after a stall, like the SDL frontend's _frame_wait.
+*/
+uint16_t _term_frame_wait(){
+    const uint64_t period = 16667;
+    uint64_t now = _term_now_us();
+
+    if(term_next_frame_us == 0 || now > term_next_frame_us + 4 * period){
+        term_next_frame_us = now;
+    }
+    if(now < term_next_frame_us){
+        struct timespec ts = {0, (term_next_frame_us - now) * 1000};
+        nanosleep(&ts, NULL);
+    }
+
+    uint16_t due = 0;
+    now = _term_now_us();
+    while(term_next_frame_us <= now){
+        term_next_frame_us += period;
+        due++;
+    }
+    return due;
+}
+
+/* Prints how many bytes per frame were sent to the terminal */
+void _term_print_report(){
+    printf("terminal output: %llu frames, %.1f bytes/frame average, %llu bytes max\n",
+    (unsigned long long) term_frames, term_frames ? (double) term_bytes / term_frames : 0.0,
+    (unsigned long long) term_max_bytes);
+}
@@ -0,0 +1,55 @@
+#ifndef CHIP8_TERM_H
+#define CHIP8_TERM_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+
+    /*
+    TERMINAL FRONTEND. AN ALTERNATIVE TO THE SDL BINDINGS IN Chip8_io.c FOR
+    HOSTS REACHED OVER SSH: THE DISPLAY IS DRAWN WITH UNICODE HALF BLOCKS (64X16
+    CELLS) OR BRAILLE (32X8 CELLS), AND THE KEYBOARD IS READ FROM A RAW,
+    NON-BLOCKING stdin. THE FRONTEND IS PICKED AT STARTUP (main.c -f), THE CORE
+    IS THE SAME.
+
+    EACH FRAME ONLY THE CELLS THAT CHANGED ARE SENT, WITH THE SHORTEST CURSOR
+    MOVE BETWEEN THEM, IN A SINGLE write(). AN UNCHANGED FRAME COSTS NOTHING.
+
+    TERMINALS REPORT KEY PRESSES BUT NOT RELEASES, SO A KEY IS HELD DOWN UNTIL
+    ITS BYTES STOP. AUTOREPEAT ONLY STARTS AFTER A DELAY (660MS ON X BY
+    DEFAULT, ABOUT 500MS ON MACOS), SO THE FIRST BYTE HOLDS THE KEY FOR THE
+    REPEAT DELAY, AND ONLY ONCE REPEATS ARRIVE DOES EACH ONE HOLD IT FOR THE
+    SHORTER CHIP8_TERM_HOLD_MS. A HELD KEY THEREFORE STAYS DOWN WITHOUT
+    STUTTERING, AT THE COST OF A TAP LASTING THE REPEAT DELAY. THE DELAY IS
+    SET PER RUN THROUGH _term_init; CHIP8_TERM_DELAY_MS DEFAULTS TO A LITTLE
+    OVER X'S, SO A FIRST REPEAT IS NEVER TAKEN FOR A NEW PRESS.
+    */
+    #ifndef CHIP8_TERM_DELAY_MS
+    #define CHIP8_TERM_DELAY_MS 700
+    #endif
+    #ifndef CHIP8_TERM_HOLD_MS
+    #define CHIP8_TERM_HOLD_MS 120
+    #endif
+
+    typedef enum {
+        CHIP8_TERM_HALFBLOCK = 0,
+        CHIP8_TERM_BRAILLE
+    } Chip8_term_glyphs;
+
+    void _term_init(Chip8_term_glyphs glyphs, const char *title, uint32_t delay_ms);
+    void _term_kill();
+    void _term_drawScreen(Chip8 *chip8);
+    void _term_drawScreenInvert(Chip8 *chip8);
+    void _term_getKeystate(Chip8 *chip8);
+    uint32_t _term_get_tick();
+    void _term_beep();
+    uint16_t _term_frame_wait();
+    void _term_print_report();
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_TERM_H */
@@ -0,0 +1,247 @@
+#include "Chip8_trace.h"
+#include <string.h>
+#include <time.h>
+
+/*
+Copies every record between tail and head out to the trace file. Returns
+the number of records written.
+*/
+static uint32_t trace_drain(Chip8_trace *trace) {
+    uint32_t tail = atomic_load_explicit(&trace->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&trace->published, memory_order_acquire);
+    uint32_t count = head - tail;
+
+    while (tail != head) {
+        /* write the contiguous run up to the end of the ring */
+        uint32_t index = tail & (CHIP8_TRACE_RING_SIZE - 1);
+        uint32_t run = CHIP8_TRACE_RING_SIZE - index;
+        if (run > head - tail)
+        run = head - tail;
+
+        fwrite(&trace->ring[index], sizeof(Chip8_trace_record), run, trace->fp);
+        tail += run;
+        atomic_store_explicit(&trace->tail, tail, memory_order_release);
+    }
+
+    return count;
+}
+
+/*
+Background writer. Drains the ring while the emulator runs, and sleeps
+for up to CHIP8_TRACE_DRAIN_MS whenever it finds the ring empty, so a
+machine running at its real speed costs it a few wakeups a second.
+*/
+static void *trace_writer(void *arg) {
+    Chip8_trace *trace = arg;
+
+    while (atomic_load_explicit(&trace->running, memory_order_acquire)) {
+        if (trace_drain(trace) > 0)
+        continue;
+
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += CHIP8_TRACE_DRAIN_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&trace->lock);
+        if (atomic_load_explicit(&trace->running, memory_order_acquire))
+        pthread_cond_timedwait(&trace->wake, &trace->lock, &until);
+        pthread_mutex_unlock(&trace->lock);
+    }
+
+    return NULL;
+}
+
+static void trace_write_header(Chip8_trace *trace) {
+    Chip8_trace_header header = {
+        .magic = {0},
+        .version = CHIP8_TRACE_VERSION,
+        .record_size = sizeof(Chip8_trace_record),
+        .stalls = trace->stalls,
+        .reserved = 0
+    };
+    memcpy(header.magic, CHIP8_TRACE_MAGIC, 4);
+    fwrite(&header, sizeof(header), 1, trace->fp);
+}
+
+Chip8_trace *chip8_trace_open(const char *filename, const Chip8_trace_trigger *start,
+const Chip8_trace_trigger *stop) {
+    Chip8_trace *trace = calloc(1, sizeof(Chip8_trace));
+    if (trace == NULL)
+    return NULL;
+
+    trace->fp = fopen(filename, "wb");
+    if (trace->fp == NULL) {
+        free(trace);
+        return NULL;
+    }
+
+    /* header is rewritten on close with the final drop count */
+    trace_write_header(trace);
+
+    if (start != NULL)
+    trace->start = *start;
+    if (stop != NULL)
+    trace->stop = *stop;
+    trace->recording = (trace->start.kind == CHIP8_TRIGGER_NONE);
+    /* the first record is always a frame record, and goes through
+    chip8_trace_slow like every instruction while a trigger is armed */
+    trace->frame = UINT32_MAX;
+
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_cond_init(&trace->wake, NULL);
+    atomic_store(&trace->running, true);
+    if (pthread_create(&trace->writer, NULL, trace_writer, trace) != 0) {
+        pthread_cond_destroy(&trace->wake);
+        pthread_mutex_destroy(&trace->lock);
+        fclose(trace->fp);
+        free(trace);
+        return NULL;
+    }
+
+    return trace;
+}
+
+/*
+Stops the writer thread, flushes any remaining records and finalizes the
+file header. Must be called from the thread that runs the emulator.
+*/
+void chip8_trace_close(Chip8_trace *trace) {
+    if (trace == NULL)
+    return;
+
+    atomic_store_explicit(&trace->published, trace->head, memory_order_release);
+    pthread_mutex_lock(&trace->lock);
+    atomic_store_explicit(&trace->running, false, memory_order_release);
+    pthread_cond_signal(&trace->wake);
+    pthread_mutex_unlock(&trace->lock);
+    pthread_join(trace->writer, NULL);
+    trace_drain(trace);
+    pthread_cond_destroy(&trace->wake);
+    pthread_mutex_destroy(&trace->lock);
+
+    fseek(trace->fp, 0, SEEK_SET);
+    trace_write_header(trace);
+
+    if (trace->stalls > 0)
+    fprintf(stderr, "trace: emulation waited for the writer %u times\n", trace->stalls);
+
+    fclose(trace->fp);
+    free(trace);
+}
+
+/*
+Waits until count records fit in the ring. Everything written so far is
+published first, so the writer has something to drain
+*/
+static void trace_reserve(Chip8_trace *trace, uint32_t count) {
+    struct timespec wait = {0, 100000};
+
+    if (trace->head - trace->tail_cache <= CHIP8_TRACE_RING_SIZE - count)
+    return;
+
+    atomic_store_explicit(&trace->published, trace->head, memory_order_release);
+    trace->tail_cache = atomic_load_explicit(&trace->tail, memory_order_acquire);
+    if (trace->head - trace->tail_cache <= CHIP8_TRACE_RING_SIZE - count)
+    return;
+
+    trace->stalls++;
+    do {
+        pthread_cond_signal(&trace->wake);
+        nanosleep(&wait, NULL);
+        trace->tail_cache = atomic_load_explicit(&trace->tail, memory_order_acquire);
+    } while (trace->head - trace->tail_cache > CHIP8_TRACE_RING_SIZE - count);
+}
+
+/*
+Everything chip8_trace_step does not do inline: start and stop triggers,
+frame records with the publish that goes with them, and waiting for room
+in the ring. Afterwards limit is set so that the next call only comes
+back here when it has to
+*/
+void chip8_trace_slow(Chip8_trace *trace, const Chip8 *chip8, uint16_t pc) {
+    bool last = false;
+
+    if (!trace->recording) {
+        if (!chip8_trace_match(&trace->start, chip8, pc))
+        return;
+        trace->recording = true;
+    }
+    else if (trace->stop.kind != CHIP8_TRIGGER_NONE && chip8_trace_match(&trace->stop, chip8, pc)) {
+        /* the instruction matching the stop trigger is still recorded */
+        last = true;
+    }
+
+    if (chip8->frames != trace->frame) {
+        trace_reserve(trace, 2);
+        /* everything before this frame goes to the writer, which is woken
+        early once it has half a ring to write */
+        atomic_store_explicit(&trace->published, trace->head, memory_order_release);
+        trace->tail_cache = atomic_load_explicit(&trace->tail, memory_order_acquire);
+        if (trace->head - trace->tail_cache >= CHIP8_TRACE_RING_SIZE / 2)
+        pthread_cond_signal(&trace->wake);
+
+        Chip8_trace_record *r = &trace->ring[trace->head++ & (CHIP8_TRACE_RING_SIZE - 1)];
+        r->frame.tag = CHIP8_TRACE_FRAME_TAG | (chip8->sp & 0xFF);
+        r->frame.delay = chip8->delay;
+        r->frame.sound = chip8->sound;
+        r->frame.frame = chip8->frames;
+        trace->frame = chip8->frames;
+    }
+    else {
+        trace_reserve(trace, 1);
+    }
+    chip8_trace_put(trace, chip8, pc);
+
+    if (last) {
+        /* the stop trigger is final, the window is not re-opened */
+        trace->recording = false;
+        trace->start.kind = CHIP8_TRIGGER_NONE;
+    }
+
+    if (trace->recording && trace->stop.kind == CHIP8_TRIGGER_NONE)
+    trace->limit = trace->tail_cache + CHIP8_TRACE_RING_SIZE;
+    else
+    trace->limit = trace->head;
+}
+
+/*
+Parses a trigger of the form "pc:0x2A0", "op:0xD000/0xF000" (value/mask,
+mask defaults to 0xFFFF) or "frame:120".
+*/
+bool chip8_trace_parse_trigger(const char *spec, Chip8_trace_trigger *trigger) {
+    const char *number;
+    char *end;
+    trigger->mask = 0xFFFF;
+
+    if (strncmp(spec, "pc:", 3) == 0) {
+        trigger->kind = CHIP8_TRIGGER_PC;
+        number = spec + 3;
+        trigger->value = strtoul(number, &end, 0);
+    }
+    else if (strncmp(spec, "op:", 3) == 0) {
+        trigger->kind = CHIP8_TRIGGER_OPCODE;
+        number = spec + 3;
+        trigger->value = strtoul(number, &end, 0);
+        if (*end == '/' && end != number) {
+            number = end + 1;
+            trigger->mask = strtoul(number, &end, 0);
+        }
+        trigger->value &= trigger->mask;
+    }
+    else if (strncmp(spec, "frame:", 6) == 0) {
+        trigger->kind = CHIP8_TRIGGER_FRAME;
+        number = spec + 6;
+        trigger->value = strtoul(number, &end, 0);
+    }
+    else {
+        trigger->kind = CHIP8_TRIGGER_NONE;
+        return false;
+    }
+
+    /* the number (and mask) must be present and make up the rest */
+    return end != number && *end == '\0';
+}
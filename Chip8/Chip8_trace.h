@@ -0,0 +1,156 @@
+#ifndef CHIP8_TRACE_H
+#define CHIP8_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+    #endif
+
+    #include "Chip8.h"
+    #include <stdatomic.h>
+    #include <pthread.h>
+
+    /*
+    BINARY EXECUTION TRACE. WHEN THE CORE IS BUILT WITH CHIP8_TRACE, EVERY
+    EXECUTED INSTRUCTION IS APPENDED AS A FIXED-SIZE RECORD TO A PER-INSTANCE
+    SINGLE-PRODUCER/SINGLE-CONSUMER RING. A BACKGROUND THREAD DRAINS THE RING
+    INTO A FILE, SO THE EMULATION LOOP NEVER BLOCKS ON I/O. NEW RECORDS ARE
+    HANDED TO THE WRITER ONCE PER FRAME. NOTHING IS DROPPED: IF THE WRITER
+    FALLS BEHIND, WHICH ONLY HAPPENS WHEN EMULATING FAR ABOVE REAL SPEED, THE
+    CORE WAITS FOR IT AND THE WAIT IS COUNTED.
+
+    WITHOUT CHIP8_TRACE, CHIP8_TRACE_STEP EXPANDS TO NOTHING.
+    */
+    #ifdef CHIP8_TRACE
+    #define CHIP8_TRACE_STEP(chip8, pc) \
+    do { if ((chip8)->trace != NULL) chip8_trace_step((chip8)->trace, (chip8), (pc)); } while (0)
+    #else
+    #define CHIP8_TRACE_STEP(chip8, pc) do { } while (0)
+    #endif
+
+    #define CHIP8_TRACE_MAGIC "C8TR"
+    #define CHIP8_TRACE_VERSION 2
+    #define CHIP8_TRACE_RING_SIZE 262144 /* records, must be a power of two */
+    #define CHIP8_TRACE_DRAIN_MS 500      /* writer wakeup period when idle */
+
+    /* pc values are fetch addresses and stay below 4KB, so a pc with any of
+    these bits set is the tag of a frame record */
+    #define CHIP8_TRACE_FRAME_TAG 0xF000
+
+    /*
+    ONE 8 BYTE RECORD PER EXECUTED INSTRUCTION, STATE SAMPLED AFTER
+    EXECUTION. THE CHANGED REGISTER IS THE X FIELD OF THE INSTRUCTION.
+    WHAT RARELY CHANGES GOES INTO A FRAME RECORD, WRITTEN BEFORE THE FIRST
+    RECORDED INSTRUCTION OF EACH FRAME AND SAMPLED, LIKE THAT INSTRUCTION'S
+    RECORD, AFTER IT EXECUTED. DECODERS TRACK THE TIMERS THROUGH FX15/FX18
+    AND SP THROUGH 2NNN/00EE UNTIL THE NEXT ONE.
+    */
+    typedef union Chip8_trace_record_t {
+        struct {
+            uint16_t pc;
+            uint16_t instruction;
+            uint16_t regI;
+            uint8_t value;  /* VX */
+            uint8_t vf;
+        } step;
+        struct {
+            uint16_t tag;   /* CHIP8_TRACE_FRAME_TAG | sp */
+            uint8_t delay;
+            uint8_t sound;
+            uint32_t frame;
+        } frame;
+    } Chip8_trace_record;
+
+    /* file header, followed by a flat array of records */
+    typedef struct Chip8_trace_header_t {
+        char magic[4];
+        uint16_t version;
+        uint16_t record_size;
+        uint32_t stalls;    /* times the core waited for the writer */
+        uint32_t reserved;
+    } Chip8_trace_header;
+
+    typedef enum {
+        CHIP8_TRIGGER_NONE = 0,
+        CHIP8_TRIGGER_PC,
+        CHIP8_TRIGGER_OPCODE,
+        CHIP8_TRIGGER_FRAME
+    } Chip8_trigger_kind;
+
+    /* start/stop condition. OPCODE matches (instruction & mask) == value,
+    FRAME matches once the frame counter reaches value. With no start
+    trigger recording begins immediately; with no stop trigger it never ends.
+    The instruction matching the stop trigger is the last one recorded */
+    typedef struct Chip8_trace_trigger_t {
+        Chip8_trigger_kind kind;
+        uint32_t value;
+        uint16_t mask;
+    } Chip8_trace_trigger;
+
+    typedef struct Chip8_trace_t {
+        /* producer side, touched on every instruction. Records up to head
+        are written, but only published to the writer once per frame. Up
+        to limit they can be appended without looking at the writer or the
+        triggers; limit equals head while a trigger is armed */
+        uint32_t head;
+        uint32_t limit;
+        uint32_t frame;     /* of the last frame record */
+        uint32_t tail_cache;
+        uint32_t stalls;
+        bool recording;
+        Chip8_trace_trigger start;
+        Chip8_trace_trigger stop;
+
+        _Atomic uint32_t published __attribute__((aligned(64)));
+
+        /* consumer side. The writer sleeps on wake between drains; the
+        core signals it when the ring is half full */
+        _Atomic uint32_t tail __attribute__((aligned(64)));
+        _Atomic bool running;
+        pthread_t writer;
+        pthread_mutex_t lock;
+        pthread_cond_t wake;
+        FILE *fp;
+
+        Chip8_trace_record ring[CHIP8_TRACE_RING_SIZE];
+    } Chip8_trace;
+
+    Chip8_trace *chip8_trace_open(const char *filename, const Chip8_trace_trigger *start,
+    const Chip8_trace_trigger *stop);
+    void chip8_trace_close(Chip8_trace *trace);
+    bool chip8_trace_parse_trigger(const char *spec, Chip8_trace_trigger *trigger);
+
+    void chip8_trace_slow(Chip8_trace *trace, const Chip8 *chip8, uint16_t pc);
+
+    static inline bool chip8_trace_match(const Chip8_trace_trigger *t, const Chip8 *chip8, uint16_t pc) {
+        switch (t->kind) {
+            case CHIP8_TRIGGER_PC: return pc == t->value;
+            case CHIP8_TRIGGER_OPCODE: return (chip8->instruction & t->mask) == t->value;
+            case CHIP8_TRIGGER_FRAME: return chip8->frames >= t->value;
+            default: return false;
+        }
+    }
+
+    static inline void chip8_trace_put(Chip8_trace *trace, const Chip8 *chip8, uint16_t pc) {
+        Chip8_trace_record *r = &trace->ring[trace->head++ & (CHIP8_TRACE_RING_SIZE - 1)];
+        r->step.pc = pc & (CHIP8_MEMSIZE - 1);
+        r->step.instruction = chip8->instruction;
+        r->step.regI = chip8->regI;
+        r->step.value = chip8->regV[(chip8->instruction & 0x0F00) >> 8];
+        r->step.vf = chip8->regV[0xF];
+    }
+
+    /* Appends a record for the instruction that was just executed at pc.
+    A new frame, a full ring or an armed trigger take the slow path */
+    static inline void chip8_trace_step(Chip8_trace *trace, const Chip8 *chip8, uint16_t pc) {
+        if (chip8->frames != trace->frame || trace->head == trace->limit) {
+            chip8_trace_slow(trace, chip8, pc);
+            return;
+        }
+        chip8_trace_put(trace, chip8, pc);
+    }
+
+    #ifdef __cplusplus
+}
+#endif
+
+#endif /* CHIP8_TRACE_H */
@@ -3,23 +3,241 @@
 #include <SDL2/SDL.h>
 
 #include <dirent.h>
+#include <string.h>
+#include <unistd.h>
 #include "Chip8/Chip8.h"
 #include "Chip8/Chip8_io.h"
+#include "Chip8/Chip8_trace.h"
+#include "Chip8/Chip8_debug.h"
+#include "Chip8/Chip8_runahead.h"
+#include "Chip8/Chip8_aot.h"
+#include "Chip8/Chip8_metrics.h"
+#include "Chip8/Chip8_term.h"
+
+/* I/O bindings and frame pacing of one frontend, picked with -f */
+typedef struct Frontend_t {
+    void (*init)();
+    void (*kill)();
+    void (*drawScreen)(Chip8 *chip8);
+    void (*drawScreenInvert)(Chip8 *chip8);
+    void (*getKeystate)(Chip8 *chip8);
+    uint32_t (*get_tick)();
+    void (*beep)();
+    uint16_t (*frame_wait)();
+} Frontend;
+
+static Chip8_term_glyphs term_glyphs;
+
+static void sdl_init(){
+    _window_init(rom_name);
+}
+
+static void sdl_kill(){
+    _print_latency_report();
+    _window_kill();
+}
+
+/* CHIP8_TERM_DELAY sets how long, in ms, a first key press is held: the
+keyboard's autorepeat delay, a little more to be safe */
+static void term_init(){
+    const char *delay = getenv("CHIP8_TERM_DELAY");
+    _term_init(term_glyphs, rom_name, delay ? atoi(delay) : 0);
+}
+
+static void term_kill(){
+    _term_kill();
+    _term_print_report();
+}
+
+/* headless runs draw nothing and read no keys; they keep to 60Hz with the
+terminal frontend's clock, which needs no terminal */
+static void headless_none(){
+}
+
+static void headless_draw(Chip8 *chip8){
+    (void) chip8;
+}
+
+static const Frontend sdl_frontend = {
+    sdl_init, sdl_kill, _drawScreen, _drawScreenInvert, _getKeystate, _get_tick, _beep, _frame_wait
+};
+
+static const Frontend term_frontend = {
+    term_init, term_kill, _term_drawScreen, _term_drawScreenInvert, _term_getKeystate, _term_get_tick,
+    _term_beep, _term_frame_wait
+};
+
+static const Frontend headless_frontend = {
+    headless_none, headless_none, headless_draw, headless_draw, headless_draw, _term_get_tick,
+    headless_none, _term_frame_wait
+};
+
+#ifdef CHIP8_XIP
+/* Reads at most one memory's worth of rom into image, returning its length */
+static uint16_t read_rom_image(const char *path, uint8_t *image){
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL){
+        perror(path);
+        return 0;
+    }
+    uint16_t length = fread(image, 1, CHIP8_MEMSIZE - 0x200, fp);
+    if(ferror(fp)){
+        perror(path);
+    }
+    else if(fgetc(fp) != EOF){
+        fprintf(stderr, "%s: only the first %d bytes fit in memory\n", path, CHIP8_MEMSIZE - 0x200);
+    }
+    fclose(fp);
+    return length;
+}
+#endif
+
+static void usage(char *name){
+    fprintf(stderr, "usage: %s [-f sdl|term|braille|headless] [-r runahead-frames] [-m restore|instance]"
+    " [-n frames] [rom]\n", name);
+    exit(2);
+}
 
 int main(int argc, char** argv) {
-    rom_name = pick_rom();
+    static Chip8_runahead runahead;
+    uint8_t runahead_frames = 0;
+    Chip8_runahead_mode runahead_mode = CHIP8_RUNAHEAD_RESTORE;
+    const Frontend *io = &sdl_frontend;
+    uint32_t max_frames = 0;
+    int opt;
+
+    while((opt = getopt(argc, argv, "f:r:m:n:")) != -1){
+        switch(opt){
+            case 'f':
+            /* term draws with half blocks, braille with braille dots */
+            if(strcmp(optarg, "sdl") == 0) io = &sdl_frontend;
+            else if(strcmp(optarg, "term") == 0) io = &term_frontend, term_glyphs = CHIP8_TERM_HALFBLOCK;
+            else if(strcmp(optarg, "braille") == 0) io = &term_frontend, term_glyphs = CHIP8_TERM_BRAILLE;
+            else if(strcmp(optarg, "headless") == 0) io = &headless_frontend;
+            else usage(argv[0]);
+            break;
+            case 'r':
+            runahead_frames = atoi(optarg);
+            break;
+            case 'm':
+            if(strcmp(optarg, "restore") == 0) runahead_mode = CHIP8_RUNAHEAD_RESTORE;
+            else if(strcmp(optarg, "instance") == 0) runahead_mode = CHIP8_RUNAHEAD_INSTANCE;
+            else usage(argv[0]);
+            break;
+            case 'n':
+            /* stop after this many presented frames, 0 runs until halted */
+            max_frames = strtoul(optarg, NULL, 0);
+            break;
+            default:
+            usage(argv[0]);
+        }
+    }
+    chip8_runahead_init(&runahead, runahead_frames, runahead_mode);
 
-    Chip8 chip8;
+    Chip8 chip8 = {0};
+    #ifdef CHIP8_AOT
+    /* the rom was translated and linked in by `make aot` */
+    rom_name = (char *) chip8_aot_rom_name;
+    chip8_loadmem(&chip8, chip8_aot_rom, chip8_aot_rom_length);
+    #elif defined(CHIP8_XIP)
+    /* the core has no file loader in XIP builds; the frontend owns the
+    image the instance executes in place */
+    static uint8_t rom_image[CHIP8_MEMSIZE - 0x200];
+    rom_name = optind < argc ? argv[optind] : pick_rom();
+    chip8_loadmem(&chip8, rom_image, read_rom_image(rom_name, rom_image));
+    #else
+    rom_name = optind < argc ? argv[optind] : pick_rom();
     chip8_loadrom(&chip8, rom_name);
-    chip8_bind_io(&_getKeystate, &_drawScreen, &_get_tick, &_beep);
+    #endif
+    chip8_bind_io(io->getKeystate, io->drawScreen, io->get_tick, io->beep);
     chip8_init(&chip8);
+
+    #ifdef CHIP8_TRACE
+    /* trace file and optional start/stop triggers are taken from the
+    environment, e.g. CHIP8_TRACE_START=pc:0x2A0 CHIP8_TRACE_STOP=frame:600 */
+    Chip8_trace_trigger start = {0}, stop = {0};
+    const char *trace_file = getenv("CHIP8_TRACE_FILE");
+    const char *trigger_vars[2] = {"CHIP8_TRACE_START", "CHIP8_TRACE_STOP"};
+    Chip8_trace_trigger *triggers[2] = {&start, &stop};
+    for(int i = 0; i < 2; i++){
+        const char *spec = getenv(trigger_vars[i]);
+        if(spec != NULL && !chip8_trace_parse_trigger(spec, triggers[i])){
+            fprintf(stderr, "%s=%s: expected pc:ADDR, op:VALUE[/MASK] or frame:N\n", trigger_vars[i], spec);
+            exit(2);
+        }
+    }
+    chip8.trace = chip8_trace_open(trace_file ? trace_file : "chip8.trace", &start, &stop);
+    #endif
     
-    _window_init(rom_name);
+    #ifdef CHIP8_METRICS
+    /* CHIP8_METRICS=/path/chip8.prom rewrites a file every
+    CHIP8_METRICS_INTERVAL ms, CHIP8_METRICS=unix:/path serves a socket.
+    For unattended runs use -f headless with the rom as argument */
+    if(getenv("CHIP8_METRICS") != NULL){
+        const char *interval = getenv("CHIP8_METRICS_INTERVAL");
+        chip8_metrics_attach(&chip8, strrchr(rom_name, '/') ? strrchr(rom_name, '/') + 1 : rom_name);
+        chip8_metrics_start(getenv("CHIP8_METRICS"), interval ? atoi(interval) : 0);
+    }
+    #endif
 
-    while(!chip8.halt){
-        chip8_clockcycle(&chip8);
+    #ifdef CHIP8_DEBUG
+    /* debugger commands come from stdin, or from CHIP8_DEBUG_SOCKET if set.
+    The terminal frontend owns stdin, so with it only the socket is used */
+    Chip8_debug *dbg = NULL;
+    if(io == &term_frontend && getenv("CHIP8_DEBUG_SOCKET") == NULL){
+        fprintf(stderr, "debugger disabled: the terminal frontend reads stdin, set CHIP8_DEBUG_SOCKET\n");
+    }
+    else{
+        dbg = chip8_debug_open(&chip8, getenv("CHIP8_DEBUG_SOCKET"));
     }
+    #endif
 
-    _window_kill();
+    io->init();
+
+    /* Each iteration is one displayed frame: wait until just before the
+    next vblank, poll input as late as possible, run the emulation frames
+    that are due, and present */
+    const Chip8 *shown = &chip8;
+    for(uint32_t presented = 0; !chip8.halt && (max_frames == 0 || presented < max_frames); presented++){
+        uint16_t due = io->frame_wait();
+
+        io->getKeystate(&chip8);
+        #ifdef CHIP8_DEBUG
+        if(dbg != NULL){
+            chip8_debug_poll(dbg);
+        }
+        #endif
+
+        /* only the last due frame is run ahead, it is the one presented */
+        for(uint16_t i = 0; i + 1 < due; i++){
+            chip8_frame(&chip8, CHIP8_CYCLES_PER_FRAME);
+        }
+        if(due > 0){
+            shown = chip8_runahead_frame(&runahead, &chip8, CHIP8_CYCLES_PER_FRAME);
+        }
+
+        if(chip8.pause){
+            io->drawScreenInvert(&chip8);
+        }
+        else{
+            io->drawScreen((Chip8 *) shown);
+        }
+        CHIP8_METRICS_ADD(&chip8, frames_presented, 1);
+    }
+
+    #ifdef CHIP8_DEBUG
+    chip8_debug_close(dbg);
+    #endif
+
+    #ifdef CHIP8_TRACE
+    chip8_trace_close(chip8.trace);
+    #endif
+
+    #ifdef CHIP8_METRICS
+    chip8_metrics_stop();
+    chip8_metrics_detach(&chip8);
+    #endif
+
+    io->kill();
     return 1;
 }
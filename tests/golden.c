@@ -0,0 +1,352 @@
+/*
+Golden-frame regression suite. Every ROM in roms/ is run headless, with a
+fixed RNG seed and the input script tests/input/<ROM>.movie (or
+tests/input/default.movie), through chip8_frame. At each checkpoint frame
+the display and the register file are hashed and compared against
+tests/golden.txt. ROMs run in parallel, one per worker thread.
+
+A mismatch prints an ASCII diff of the frame: '#' lit in both, '+' lit only
+now, '-' lit only in the golden frame.
+
+usage: golden [-u] [-j jobs] [-g golden.txt] [-i input-dir] [-r rom-dir] [rom...]
+    -u  rewrite the golden file from the current core instead of checking
+Naming roms checks only those; `make check` uses this to replay each rom
+through a core with that rom's translation linked in.
+*/
+
+#include "Chip8.h"
+#include "Chip8_movie.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GOLDEN_SEED 0xC8C8C8C8
+#define MAX_ROMS 256
+
+static const uint32_t checkpoints[] = {30, 150, 300, 600};
+#define NUM_CHECKPOINTS (sizeof(checkpoints) / sizeof(checkpoints[0]))
+
+typedef struct Golden_frame_t {
+    uint64_t display_hash;
+    uint64_t regs_hash;
+    uint8_t display[8][32];
+} Golden_frame;
+
+/* any name a directory entry can have, so none is cut short */
+#define GOLDEN_NAME_SIZE sizeof(((struct dirent *) 0)->d_name)
+
+typedef struct Golden_job_t {
+    char name[GOLDEN_NAME_SIZE];
+    bool loaded;
+    /* why the rom could not be run, when not loaded */
+    char error[600];
+    Golden_frame actual[NUM_CHECKPOINTS];
+    bool have_expected[NUM_CHECKPOINTS];
+    Golden_frame expected[NUM_CHECKPOINTS];
+} Golden_job;
+
+static Golden_job jobs[MAX_ROMS];
+static Chip8 instances[MAX_ROMS];
+static int num_jobs;
+static atomic_int next_job;
+static const char *rom_dir = "roms";
+static const char *input_dir = "tests/input";
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static uint64_t hash_regs(const Chip8 *chip8) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+    h = fnv1a(h, chip8->regV, sizeof(chip8->regV));
+    h = fnv1a(h, &chip8->regI, sizeof(chip8->regI));
+    h = fnv1a(h, &chip8->pc, sizeof(chip8->pc));
+    h = fnv1a(h, &chip8->sp, sizeof(chip8->sp));
+    h = fnv1a(h, chip8->stack, sizeof(chip8->stack));
+    h = fnv1a(h, &chip8->delay, sizeof(chip8->delay));
+    h = fnv1a(h, &chip8->sound, sizeof(chip8->sound));
+    return h;
+}
+
+static void run_job(Golden_job *job) {
+    char path[512];
+    Chip8 *chip8 = &instances[job - jobs];
+    Chip8_movie movie;
+
+    snprintf(path, sizeof(path), "%s/%s", rom_dir, job->name);
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        snprintf(job->error, sizeof(job->error), "could not load rom");
+        return;
+    }
+    /* the XIP backend executes this buffer in place, so it is only freed
+    once the instance is done with it */
+    uint8_t *rom = calloc(1, CHIP8_MEMSIZE);
+    if (rom == NULL) {
+        fclose(fp);
+        snprintf(job->error, sizeof(job->error), "out of memory");
+        return;
+    }
+    uint16_t length = fread(rom, 1, CHIP8_MEMSIZE - 0x200, fp);
+    fclose(fp);
+
+    if (!chip8_movie_load_for_rom(&movie, input_dir, job->name, path, sizeof(path))) {
+        snprintf(job->error, sizeof(job->error), "could not load input %s", path);
+        free(rom);
+        return;
+    }
+
+    chip8_loadmem(chip8, rom, length);
+    chip8_init(chip8);
+    chip8_seed(chip8, movie.seed ? movie.seed : GOLDEN_SEED);
+
+    uint32_t frame = 0;
+    for (size_t c = 0; c < NUM_CHECKPOINTS; c++) {
+        for (; frame < checkpoints[c]; frame++) {
+            chip8->keypad = chip8_movie_keypad(&movie, frame);
+            chip8_frame(chip8, CHIP8_CYCLES_PER_FRAME);
+        }
+
+        Golden_frame *g = &job->actual[c];
+        memcpy(g->display, chip8->display, sizeof(g->display));
+        g->display_hash = fnv1a(0xCBF29CE484222325ULL, chip8->display, sizeof(chip8->display));
+        g->regs_hash = hash_regs(chip8);
+    }
+
+    chip8_movie_free(&movie);
+    free(rom);
+    job->loaded = true;
+}
+
+static void *worker(void *arg) {
+    int i;
+
+    (void) arg;
+    while ((i = atomic_fetch_add(&next_job, 1)) < num_jobs)
+    run_job(&jobs[i]);
+    return NULL;
+}
+
+static void find_roms() {
+    char **names;
+    int count = chip8_movie_list_roms(rom_dir, &names);
+
+    if (count < 0) {
+        perror(rom_dir);
+        exit(1);
+    }
+    for (int i = 0; i < count && num_jobs < MAX_ROMS; i++)
+    snprintf(jobs[num_jobs++].name, sizeof(jobs[0].name), "%s", names[i]);
+    chip8_movie_free_roms(names, count);
+}
+
+/* Keeps only the named roms, failing if one of them is not in rom_dir */
+static bool select_roms(char **names, int count) {
+    int kept = 0;
+
+    for (int n = 0; n < count; n++) {
+        int j = kept;
+        while (j < num_jobs && strcmp(jobs[j].name, names[n]) != 0)
+        j++;
+        if (j == num_jobs) {
+            fprintf(stderr, "%s: no rom %s\n", rom_dir, names[n]);
+            return false;
+        }
+        Golden_job job = jobs[j];
+        jobs[j] = jobs[kept];
+        jobs[kept++] = job;
+    }
+    num_jobs = kept;
+    return true;
+}
+
+static bool hex_to_display(const char *hex, uint8_t display[8][32]) {
+    uint8_t *p = &display[0][0];
+    for (int i = 0; i < 256; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1)
+        return false;
+        p[i] = byte;
+    }
+    return true;
+}
+
+static void read_golden(const char *filename) {
+    FILE *fp = fopen(filename, "r");
+    char line[1024], name[GOLDEN_NAME_SIZE], hex[600];
+    unsigned long frame;
+    unsigned long long dhash, rhash;
+
+    if (fp == NULL)
+    return;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        /* the width is GOLDEN_NAME_SIZE - 1 */
+        if (line[0] == '#' || sscanf(line, "%255s %lu %llx %llx %599s", name, &frame, &dhash, &rhash, hex) != 5)
+        continue;
+        for (int j = 0; j < num_jobs; j++) {
+            if (strcmp(jobs[j].name, name) != 0)
+            continue;
+            for (size_t c = 0; c < NUM_CHECKPOINTS; c++) {
+                if (checkpoints[c] != frame)
+                continue;
+                jobs[j].expected[c].display_hash = dhash;
+                jobs[j].expected[c].regs_hash = rhash;
+                jobs[j].have_expected[c] = hex_to_display(hex, jobs[j].expected[c].display);
+            }
+        }
+    }
+    fclose(fp);
+}
+
+static bool write_golden(const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL)
+    return false;
+
+    fprintf(fp, "# rom frame display-hash register-hash display\n");
+    for (int j = 0; j < num_jobs; j++) {
+        if (!jobs[j].loaded)
+        continue;
+        for (size_t c = 0; c < NUM_CHECKPOINTS; c++) {
+            Golden_frame *g = &jobs[j].actual[c];
+            const uint8_t *p = &g->display[0][0];
+            fprintf(fp, "%s %u %016llx %016llx ", jobs[j].name, checkpoints[c],
+            (unsigned long long) g->display_hash, (unsigned long long) g->regs_hash);
+            for (int i = 0; i < 256; i++)
+            fprintf(fp, "%02x", p[i]);
+            fputc('\n', fp);
+        }
+    }
+    return fclose(fp) == 0;
+}
+
+static bool lit(const uint8_t display[8][32], int x, int y) {
+    return display[x / 8][y] & (1 << (x % 8));
+}
+
+static void print_diff(const Golden_frame *expected, const Golden_frame *actual) {
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        printf("    ");
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            bool was = lit(expected->display, x, y);
+            bool is = lit(actual->display, x, y);
+            putchar(was && is ? '#' : is ? '+' : was ? '-' : '.');
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char** argv) {
+    const char *golden_file = "tests/golden.txt";
+    bool update = false;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "uj:g:i:r:")) != -1) {
+        switch (opt) {
+            case 'u': update = true; break;
+            case 'j': threads = atol(optarg); break;
+            case 'g': golden_file = optarg; break;
+            case 'i': input_dir = optarg; break;
+            case 'r': rom_dir = optarg; break;
+            default:
+            fprintf(stderr, "usage: golden [-u] [-j jobs] [-g golden.txt] [-i input-dir] [-r rom-dir] [rom...]\n");
+            return 2;
+        }
+    }
+    if (threads < 1)
+    threads = 1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* a partial golden file would drop every rom not named */
+    if (update && optind < argc) {
+        fprintf(stderr, "golden: -u rewrites the whole file, do not name roms\n");
+        return 2;
+    }
+    find_roms();
+    if (optind < argc && !select_roms(argv + optind, argc - optind))
+    return 1;
+
+    pthread_t workers[64];
+    if (threads > 64)
+    threads = 64;
+    for (long t = 0; t < threads; t++)
+    pthread_create(&workers[t], NULL, worker, NULL);
+    for (long t = 0; t < threads; t++)
+    pthread_join(workers[t], NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (update) {
+        /* never drop a rom from the golden file because its input is broken */
+        int failures = 0;
+        for (int j = 0; j < num_jobs; j++) {
+            if (!jobs[j].loaded) {
+                printf("FAIL %s: %s\n", jobs[j].name, jobs[j].error);
+                failures++;
+            }
+        }
+        if (failures) {
+            printf("%s not written: %d roms failed\n", golden_file, failures);
+            return 1;
+        }
+        if (!write_golden(golden_file)) {
+            perror(golden_file);
+            return 1;
+        }
+        printf("wrote %s: %d roms, %zu checkpoints each\n", golden_file, num_jobs, NUM_CHECKPOINTS);
+        return 0;
+    }
+
+    read_golden(golden_file);
+
+    int failures = 0;
+    for (int j = 0; j < num_jobs; j++) {
+        Golden_job *job = &jobs[j];
+        bool ok = job->loaded;
+
+        if (!job->loaded)
+        printf("FAIL %s: %s\n", job->name, job->error);
+
+        for (size_t c = 0; c < NUM_CHECKPOINTS && job->loaded; c++) {
+            Golden_frame *e = &job->expected[c];
+            Golden_frame *a = &job->actual[c];
+
+            if (!job->have_expected[c]) {
+                printf("FAIL %s frame %u: no golden value (regenerate with -u)\n", job->name, checkpoints[c]);
+                ok = false;
+                continue;
+            }
+            if (e->display_hash != a->display_hash || e->regs_hash != a->regs_hash) {
+                printf("FAIL %s frame %u: display %016llx (golden %016llx), registers %016llx (golden %016llx)\n",
+                job->name, checkpoints[c], (unsigned long long) a->display_hash,
+                (unsigned long long) e->display_hash, (unsigned long long) a->regs_hash,
+                (unsigned long long) e->regs_hash);
+                print_diff(e, a);
+                ok = false;
+                /* later checkpoints of the same rom only repeat the failure */
+                break;
+            }
+        }
+
+        if (ok)
+        printf("ok   %s\n", job->name);
+        else
+        failures++;
+    }
+
+    printf("%d roms, %d failed, %.3f s on %ld threads\n", num_jobs, failures, elapsed, threads);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,134 @@
+/*
+Metrics consistency check. Every ROM in roms/ is run headless for a fixed
+number of frames, with the input script used by the golden suite, once
+without run-ahead and once with run-ahead in each mode. Speculative frames
+must not be counted, so all three runs have to report the same counters.
+
+usage: metrics [-f frames] [-a runahead-frames] [-i input-dir] [-r rom-dir]
+*/
+
+#include "Chip8.h"
+#include "Chip8_metrics.h"
+#include "Chip8_movie.h"
+#include "Chip8_runahead.h"
+#include <string.h>
+#include <unistd.h>
+
+#define METRICS_SEED 0xC8C8C8C8
+
+typedef struct Metrics_counts_t {
+    uint64_t instructions;
+    uint64_t frames_emulated;
+    uint64_t key_wait_frames;
+    uint64_t draws;
+    uint64_t collisions;
+} Metrics_counts;
+
+static const char *rom_dir = "roms";
+static const char *input_dir = "tests/input";
+static uint32_t frames = 600;
+static uint8_t ahead = 2;
+
+static Chip8_runahead runahead;
+
+static void run(const char *name, uint8_t *rom, uint16_t length, const Chip8_movie *movie,
+uint8_t runahead_frames, Chip8_runahead_mode mode, Metrics_counts *counts) {
+    static Chip8 chip8;
+
+    memset(&chip8, 0, sizeof(chip8));
+    chip8_loadmem(&chip8, rom, length);
+    chip8_init(&chip8);
+    chip8_seed(&chip8, movie->seed ? movie->seed : METRICS_SEED);
+    chip8_metrics_attach(&chip8, name);
+    chip8_runahead_init(&runahead, runahead_frames, mode);
+
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        chip8.keypad = chip8_movie_keypad(movie, frame);
+        chip8_runahead_frame(&runahead, &chip8, CHIP8_CYCLES_PER_FRAME);
+    }
+
+    Chip8_metrics *m = chip8.metrics;
+    counts->instructions = m->instructions;
+    counts->frames_emulated = m->frames_emulated;
+    counts->key_wait_frames = m->key_wait_frames;
+    counts->draws = m->draws;
+    counts->collisions = m->collisions;
+    chip8_metrics_detach(&chip8);
+}
+
+static void print_counts(const char *label, const Metrics_counts *c) {
+    printf("    %-8s instructions %llu, frames %llu, key wait %llu, draws %llu, collisions %llu\n", label,
+    (unsigned long long) c->instructions, (unsigned long long) c->frames_emulated,
+    (unsigned long long) c->key_wait_frames, (unsigned long long) c->draws,
+    (unsigned long long) c->collisions);
+}
+
+/* Returns false when the rom or its input cannot be loaded, or when the
+counters of the three runs differ */
+static bool check_rom(const char *name) {
+    static uint8_t rom[CHIP8_MEMSIZE];
+    char path[512];
+    Chip8_movie movie;
+
+    snprintf(path, sizeof(path), "%s/%s", rom_dir, name);
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        printf("FAIL %s: could not load rom\n", name);
+        return false;
+    }
+    uint16_t length = fread(rom, 1, CHIP8_MEMSIZE - 0x200, fp);
+    fclose(fp);
+
+    if (!chip8_movie_load_for_rom(&movie, input_dir, name, path, sizeof(path))) {
+        printf("FAIL %s: could not load input %s\n", name, path);
+        return false;
+    }
+
+    Metrics_counts plain, restore, instance;
+    run(name, rom, length, &movie, 0, CHIP8_RUNAHEAD_RESTORE, &plain);
+    run(name, rom, length, &movie, ahead, CHIP8_RUNAHEAD_RESTORE, &restore);
+    run(name, rom, length, &movie, ahead, CHIP8_RUNAHEAD_INSTANCE, &instance);
+    chip8_movie_free(&movie);
+
+    if (memcmp(&plain, &restore, sizeof(plain)) != 0 || memcmp(&plain, &instance, sizeof(plain)) != 0) {
+        printf("FAIL %s: counters differ with %u frames run-ahead\n", name, ahead);
+        print_counts("none", &plain);
+        print_counts("restore", &restore);
+        print_counts("instance", &instance);
+        return false;
+    }
+
+    printf("ok   %s\n", name);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    char **names;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:a:i:r:")) != -1) {
+        switch (opt) {
+            case 'f': frames = strtoul(optarg, NULL, 0); break;
+            case 'a': ahead = strtoul(optarg, NULL, 0); break;
+            case 'i': input_dir = optarg; break;
+            case 'r': rom_dir = optarg; break;
+            default:
+            fprintf(stderr, "usage: metrics [-f frames] [-a runahead-frames] [-i input-dir] [-r rom-dir]\n");
+            return 2;
+        }
+    }
+
+    int num_roms = chip8_movie_list_roms(rom_dir, &names);
+    if (num_roms < 0) {
+        perror(rom_dir);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < num_roms; i++)
+    failures += !check_rom(names[i]);
+    chip8_movie_free_roms(names, num_roms);
+
+    printf("%d roms, %d failed, %u frames, %u frames run-ahead\n", num_roms, failures, frames, ahead);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,320 @@
+/*
+Ahead-of-time translator. Walks the code reachable from 0x200 in a ROM and
+writes a C file with one labelled block per instruction address. Jumps,
+calls and skips become direct gotos; 00EE and BNNN, whose targets are only
+known at run time, go through a switch on PC. The ROM image is embedded so
+the result links into a self-contained binary (see `make aot`).
+
+Translated code keeps exact interpreter semantics, including the number of
+instructions per frame. PCs that were not reached by the walk fall back to
+the interpreter one instruction at a time, and any FX33/FX55 store that
+lands on translated code hands the instance over to the interpreter.
+
+usage: chip8-aot rom [output.c]
+*/
+
+#include "Chip8.h"
+#include <string.h>
+
+static uint8_t memory[CHIP8_MEMSIZE];
+static uint16_t rom_end;
+static bool reachable[CHIP8_MEMSIZE];
+static uint16_t worklist[CHIP8_MEMSIZE];
+static int worklist_len;
+
+static bool in_rom(uint32_t addr) {
+    return addr >= 0x200 && addr + 1 < rom_end;
+}
+
+static uint16_t fetch(uint16_t addr) {
+    return (memory[addr] << 8) | memory[addr + 1];
+}
+
+static void mark(uint32_t addr) {
+    if (in_rom(addr) && !reachable[addr]) {
+        reachable[addr] = true;
+        worklist[worklist_len++] = addr;
+    }
+}
+
+/*
+Recursive-descent walk over the control flow graph. BNNN and 00EE end a
+path, since their targets depend on run-time state.
+*/
+static void find_reachable() {
+    mark(0x200);
+
+    while (worklist_len > 0) {
+        uint16_t addr = worklist[--worklist_len];
+        uint16_t ins = fetch(addr);
+        uint16_t nnn = ins & 0x0FFF;
+        uint8_t nn = ins & 0x00FF;
+
+        switch (ins & 0xF000) {
+            case 0x0000:
+            if (ins != 0x00EE)
+            mark(addr + 2);
+            break;
+
+            case 0x1000:
+            mark(nnn);
+            break;
+
+            case 0x2000:
+            mark(nnn);
+            mark(addr + 2);
+            break;
+
+            case 0x3000: case 0x4000: case 0x5000: case 0x9000:
+            mark(addr + 2);
+            mark(addr + 4);
+            break;
+
+            case 0xB000:
+            break;
+
+            case 0xE000:
+            mark(addr + 2);
+            if (nn == 0x9E || nn == 0xA1)
+            mark(addr + 4);
+            break;
+
+            default:
+            mark(addr + 2);
+            break;
+        }
+    }
+}
+
+static void emit_goto(FILE *out, uint32_t target) {
+    if (target < CHIP8_MEMSIZE && reachable[target])
+    fprintf(out, "goto L_%03X;", target);
+    else
+    fprintf(out, "{ PC = 0x%03X; goto dispatch; }", target & 0xFFFF);
+}
+
+/* Conditional skip: `cond` true skips the next instruction */
+static void emit_skip(FILE *out, uint16_t addr, const char *cond) {
+    fprintf(out, "    if (%s) ", cond);
+    emit_goto(out, addr + 4);
+    fprintf(out, "\n    ");
+    emit_goto(out, addr + 2);
+    fprintf(out, "\n");
+}
+
+/* Executes the instruction through the interpreter's opcode function */
+static void emit_call(FILE *out, uint16_t addr, uint16_t ins) {
+    fprintf(out, "    INSTRUCTION = 0x%04X; PC = 0x%03X; chip8_op%X(chip8);\n", ins, addr + 2, ins >> 12);
+}
+
+static void emit_instruction(FILE *out, uint16_t addr) {
+    uint16_t ins = fetch(addr);
+    uint8_t x = (ins & 0x0F00) >> 8;
+    uint8_t y = (ins & 0x00F0) >> 4;
+    uint16_t nnn = ins & 0x0FFF;
+    uint8_t nn = ins & 0x00FF;
+    uint8_t n = ins & 0x000F;
+    char text[64];
+
+    chip8_disassemble(ins, text, sizeof(text));
+    fprintf(out, "L_%03X: /* %04X  %s */\n", addr, ins, text);
+    fprintf(out, "    if (left == 0) { PC = 0x%03X; *budget = 0; return CHIP8_AOT_OK; }\n", addr);
+    fprintf(out, "    left--;\n");
+
+    switch (ins & 0xF000) {
+        case 0x0000:
+        if (ins == 0x00E0) {
+            fprintf(out, "    memset(DISPLAY, 0, sizeof(DISPLAY));\n");
+        }
+        else if (ins == 0x00EE) {
+            fprintf(out, "    SP -= 1; PC = STACK[SP]; goto dispatch;\n");
+            return;
+        }
+        break;
+
+        case 0x1000:
+        fprintf(out, "    ");
+        emit_goto(out, nnn);
+        fprintf(out, "\n");
+        return;
+
+        case 0x2000:
+        fprintf(out, "    STACK[SP] = 0x%03X; SP++;\n    ", addr + 2);
+        emit_goto(out, nnn);
+        fprintf(out, "\n");
+        return;
+
+        case 0x3000:
+        snprintf(text, sizeof(text), "V[0x%X] == 0x%02X", x, nn);
+        emit_skip(out, addr, text);
+        return;
+
+        case 0x4000:
+        snprintf(text, sizeof(text), "V[0x%X] != 0x%02X", x, nn);
+        emit_skip(out, addr, text);
+        return;
+
+        case 0x5000:
+        snprintf(text, sizeof(text), "V[0x%X] == V[0x%X]", x, y);
+        emit_skip(out, addr, text);
+        return;
+
+        case 0x6000:
+        fprintf(out, "    V[0x%X] = 0x%02X;\n", x, nn);
+        break;
+
+        case 0x7000:
+        fprintf(out, "    V[0x%X] += 0x%02X;\n", x, nn);
+        break;
+
+        case 0x8000:
+        switch (n) {
+            case 0x0: fprintf(out, "    V[0x%X] = V[0x%X];\n", x, y); break;
+            case 0x1: fprintf(out, "    V[0x%X] |= V[0x%X];\n", x, y); break;
+            case 0x2: fprintf(out, "    V[0x%X] &= V[0x%X];\n", x, y); break;
+            case 0x3: fprintf(out, "    V[0x%X] ^= V[0x%X];\n", x, y); break;
+            /* flag-setting forms keep the interpreter's evaluation order */
+            default: emit_call(out, addr, ins); break;
+        }
+        break;
+
+        case 0x9000:
+        snprintf(text, sizeof(text), "V[0x%X] != V[0x%X]", x, y);
+        emit_skip(out, addr, text);
+        return;
+
+        case 0xA000:
+        fprintf(out, "    I = 0x%03X;\n", nnn);
+        break;
+
+        case 0xB000:
+        fprintf(out, "    PC = 0x%03X + V[0]; goto dispatch;\n", nnn);
+        return;
+
+        case 0xE000:
+        if (nn == 0x9E) {
+            snprintf(text, sizeof(text), "KEYTEST(V[0x%X]) != 0", x);
+            emit_skip(out, addr, text);
+            return;
+        }
+        if (nn == 0xA1) {
+            snprintf(text, sizeof(text), "KEYTEST(V[0x%X]) == 0", x);
+            emit_skip(out, addr, text);
+            return;
+        }
+        break;
+
+        case 0xF000:
+        switch (nn) {
+            case 0x07: fprintf(out, "    V[0x%X] = DELAY;\n", x); break;
+            case 0x15: fprintf(out, "    DELAY = V[0x%X];\n", x); break;
+            case 0x18: fprintf(out, "    SOUND = V[0x%X];\n", x); break;
+            case 0x1E: fprintf(out, "    I += V[0x%X];\n", x); break;
+            case 0x29: fprintf(out, "    I = V[0x%X]*5;\n", x); break;
+
+            case 0x0A:
+            /* re-executes itself until a key is down */
+            emit_call(out, addr, ins);
+            fprintf(out, "    if (PC != 0x%03X) goto L_%03X;\n", addr + 2, addr);
+            break;
+
+            case 0x33: case 0x55:
+            /* stores: leave translated code for good if they hit it */
+            fprintf(out, "    { uint16_t w = I;\n    ");
+            emit_call(out, addr, ins);
+            fprintf(out, "    if (HALT) { *budget = left; return CHIP8_AOT_FALLBACK; }\n");
+            fprintf(out, "    if (aot_is_code(w, %u)) { *budget = left; return CHIP8_AOT_MODIFIED; } }\n",
+            nn == 0x33 ? 3 : x + 1);
+            break;
+
+            default:
+            emit_call(out, addr, ins);
+            break;
+        }
+        break;
+
+        default:
+        emit_call(out, addr, ins);
+        break;
+    }
+
+    fprintf(out, "    ");
+    emit_goto(out, addr + 2);
+    fprintf(out, "\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: chip8-aot rom [output.c]\n");
+        return 2;
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    uint16_t length = fread(&memory[0x200], 1, CHIP8_MEMSIZE - 0x200, fp);
+    fclose(fp);
+    rom_end = 0x200 + length;
+
+    FILE *out = stdout;
+    if (argc == 3 && (out = fopen(argv[2], "w")) == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    find_reachable();
+
+    const char *name = strrchr(argv[1], '/') ? strrchr(argv[1], '/') + 1 : argv[1];
+    int blocks = 0;
+    uint8_t code[CHIP8_MEMSIZE / 8] = {0};
+    for (uint16_t a = 0; a < CHIP8_MEMSIZE; a++) {
+        if (reachable[a]) {
+            blocks++;
+            code[a / 8] |= 1 << (a % 8);
+            code[(a + 1) / 8] |= 1 << ((a + 1) % 8);
+        }
+    }
+
+    fprintf(out, "/* Generated by chip8-aot from %s: %d of %u bytes translated. Do not edit. */\n\n", name, blocks * 2, length);
+    fprintf(out, "#include \"Chip8.h\"\n#include \"Chip8_aot.h\"\n#include <string.h>\n\n");
+
+    fprintf(out, "const char chip8_aot_rom_name[] = \"%s\";\n", name);
+    fprintf(out, "const uint16_t chip8_aot_rom_length = %u;\n", length);
+    fprintf(out, "const uint8_t chip8_aot_rom[] = {");
+    for (uint16_t i = 0; i < length; i++)
+    fprintf(out, "%s0x%02X,", (i % 16) ? " " : "\n    ", memory[0x200 + i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "/* bytes covered by translated instructions */\nstatic const uint8_t aot_code[%d] = {", CHIP8_MEMSIZE / 8);
+    for (int i = 0; i < CHIP8_MEMSIZE / 8; i++)
+    fprintf(out, "%s0x%02X,", (i % 16) ? " " : "\n    ", code[i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static inline bool aot_is_code(uint16_t addr, uint16_t len) {\n");
+    fprintf(out, "    for (uint16_t i = 0; i < len; i++) {\n");
+    fprintf(out, "        uint16_t a = (addr + i) & (CHIP8_MEMSIZE - 1);\n");
+    fprintf(out, "        if (aot_code[a / 8] & (1 << (a %% 8)))\n");
+    fprintf(out, "        return true;\n");
+    fprintf(out, "    }\n    return false;\n}\n\n");
+
+    fprintf(out, "int chip8_aot_run(Chip8 *chip8, uint32_t *budget) {\n");
+    fprintf(out, "    uint32_t left = *budget;\n\n");
+    fprintf(out, "dispatch:\n    switch (PC) {\n");
+    for (uint16_t a = 0; a < CHIP8_MEMSIZE; a++)
+    if (reachable[a])
+    fprintf(out, "        case 0x%03X: goto L_%03X;\n", a, a);
+    fprintf(out, "        default: *budget = left; return CHIP8_AOT_FALLBACK;\n    }\n\n");
+
+    for (uint16_t a = 0; a < CHIP8_MEMSIZE; a++)
+    if (reachable[a])
+    emit_instruction(out, a);
+
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+    fclose(out);
+    fprintf(stderr, "%s: translated %d instructions\n", name, blocks);
+    return 0;
+}
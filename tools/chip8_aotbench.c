@@ -0,0 +1,83 @@
+/*
+Speed of one ROM run flat out through chip8_frame, headless, with no keys
+down and a fixed seed. Built without CHIP8_AOT it measures the
+interpreter; built with CHIP8_AOT and the ROM's translation linked in (see
+`make aotbench`) it measures the translated code. Reports whether the
+translation actually ran, since chip8_frame interprets a ROM it was not
+translated from, and one whose translated code a store overwrote.
+
+The run is repeated -k times and the minimum and median time per frame
+are printed, along with the instruction rate and the speed relative to
+real time (60 frames per second).
+
+usage: chip8-aotbench [-n frames] [-k repeats] rom
+*/
+
+#include "Chip8.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+    uint32_t frames = 100000;
+    uint32_t repeats = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:k:")) != -1) {
+        switch (opt) {
+            case 'n': frames = strtoul(optarg, NULL, 0); break;
+            case 'k': repeats = strtoul(optarg, NULL, 0); break;
+            default:
+            fprintf(stderr, "usage: chip8-aotbench [-n frames] [-k repeats] rom\n");
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || frames == 0 || repeats == 0 || repeats > 100) {
+        fprintf(stderr, "usage: chip8-aotbench [-n frames] [-k repeats] rom\n");
+        return 2;
+    }
+
+    FILE *fp = fopen(argv[optind], "rb");
+    if (fp == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    static uint8_t rom[CHIP8_MEMSIZE];
+    uint16_t length = fread(rom, 1, CHIP8_MEMSIZE - 0x200, fp);
+    fclose(fp);
+
+    static Chip8 chip8;
+    double ns[100];
+    uint32_t ran = frames;
+
+    for (uint32_t k = 0; k < repeats; k++) {
+        chip8_loadmem(&chip8, rom, length);
+        chip8_init(&chip8);
+        chip8_seed(&chip8, 1);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (ran = 0; ran < frames && !chip8.halt; ran++)
+        chip8_frame(&chip8, CHIP8_CYCLES_PER_FRAME);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        ns[k] = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / ran;
+    }
+    qsort(ns, repeats, sizeof(double), compare_doubles);
+
+    #ifdef CHIP8_AOT
+    const char *core = chip8.aot_modified ? "translated, fell back to interpreting" : "translated";
+    #else
+    const char *core = "interpreted";
+    #endif
+    double median = ns[repeats / 2];
+    printf("%s: %s, %u frames%s, %u repeats\n", argv[optind], core, ran, chip8.halt ? " (halted)" : "", repeats);
+    printf("  %8.1f ns/frame min, %8.1f median, %7.1f M instructions/s, %8.0fx real time\n", ns[0], median,
+    CHIP8_CYCLES_PER_FRAME / median * 1e3, 1e9 / 60 / median);
+    return 0;
+}
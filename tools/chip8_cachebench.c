@@ -0,0 +1,207 @@
+/*
+Cache behaviour of stepping many instances. Loads one ROM into n
+instances, lets their PCs drift apart, then steps them round-robin, one
+instruction per instance per round, which is the worst case for the data
+cache: every step lands on a different instance.
+
+Reports, per instance step, the time and the hardware counts of L1 data
+cache read misses and of the kernel's generic cache-miss event. On AMD Zen
+that event counts demand misses in L2 (PMCx064); on Intel, last-level
+misses. Lines the hardware prefetcher brought in do not count, so a
+working set the prefetcher can stream, however large, shows few. Counters
+come from perf_event_open and are reported as n/a when it is not
+permitted. It also prints how many cache lines the per-instruction fields
+of Chip8 span.
+
+The measurement is repeated -k times and the minimum and median of each
+figure are printed; single runs on a shared host vary severalfold. -p adds
+lines of padding between instances, to compare strides: an even number of
+lines maps every instance's hot line into half of the cache sets.
+
+usage: chip8-cachebench [-n instances] [-r rounds] [-k repeats] [-p pad-lines] rom
+*/
+
+#include "Chip8.h"
+#include <linux/perf_event.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct Bench_counter_t {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+    uint64_t value;
+} Bench_counter;
+
+static Bench_counter counters[] = {
+    {"L1D read misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1, 0},
+    {"cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1, 0},
+};
+#define NUM_COUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+static void counters_open() {
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counters[c].type;
+        attr.config = counters[c].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        counters[c].fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+}
+
+static void counters_enable(bool on) {
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        if (counters[c].fd < 0)
+        continue;
+        if (on) {
+            ioctl(counters[c].fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters[c].fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        else {
+            ioctl(counters[c].fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counters[c].fd, &counters[c].value, sizeof(uint64_t)) != sizeof(uint64_t))
+            counters[c].fd = -1;
+        }
+    }
+}
+
+/* Number of cache lines covered by the fields chip8_step touches on every
+instruction */
+static int hot_lines() {
+    static const size_t fields[][2] = {
+        {offsetof(Chip8, regV), sizeof(((Chip8 *) 0)->regV)},
+        {offsetof(Chip8, pc), sizeof(uint16_t)},
+        {offsetof(Chip8, instruction), sizeof(uint16_t)},
+        {offsetof(Chip8, regI), sizeof(uint16_t)},
+        {offsetof(Chip8, sp), sizeof(((Chip8 *) 0)->sp)},
+        {offsetof(Chip8, keypad), sizeof(uint16_t)},
+        {offsetof(Chip8, delay), sizeof(uint8_t)},
+        {offsetof(Chip8, sound), sizeof(uint8_t)},
+        {offsetof(Chip8, halt), sizeof(bool)},
+        {offsetof(Chip8, pause), sizeof(bool)},
+        {offsetof(Chip8, frames), sizeof(uint32_t)},
+        {offsetof(Chip8, rng), sizeof(uint32_t)},
+    };
+    bool used[sizeof(Chip8) / 64 + 1] = {0};
+    int lines = 0;
+
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        for (size_t line = fields[f][0] / 64; line <= (fields[f][0] + fields[f][1] - 1) / 64; line++) {
+            if (!used[line])
+            lines++;
+            used[line] = true;
+        }
+    }
+    return lines;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Prints the minimum and median of one figure over the repeats */
+static void print_figure(const char *name, double *values, uint32_t repeats, const char *unit) {
+    qsort(values, repeats, sizeof(double), compare_doubles);
+    printf("  %-16s %8.3f %8.3f %s\n", name, values[0], values[repeats / 2], unit);
+}
+
+int main(int argc, char** argv) {
+    uint32_t count = 4096;
+    uint32_t rounds = 2000;
+    uint32_t repeats = 5;
+    size_t pad_lines = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:k:p:")) != -1) {
+        switch (opt) {
+            case 'n': count = strtoul(optarg, NULL, 0); break;
+            case 'r': rounds = strtoul(optarg, NULL, 0); break;
+            case 'k': repeats = strtoul(optarg, NULL, 0); break;
+            case 'p': pad_lines = strtoul(optarg, NULL, 0); break;
+            default:
+            fprintf(stderr, "usage: chip8-cachebench [-n instances] [-r rounds] [-k repeats] [-p pad-lines] rom\n");
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || count == 0 || repeats == 0 || repeats > 100) {
+        fprintf(stderr, "usage: chip8-cachebench [-n instances] [-r rounds] [-k repeats] [-p pad-lines] rom\n");
+        return 2;
+    }
+
+    FILE *fp = fopen(argv[optind], "rb");
+    if (fp == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    static uint8_t rom[CHIP8_MEMSIZE];
+    uint16_t length = fread(rom, 1, CHIP8_MEMSIZE - 0x200, fp);
+    fclose(fp);
+
+    size_t stride = sizeof(Chip8) + pad_lines * CHIP8_CACHE_LINE;
+    uint8_t *instances = aligned_alloc(CHIP8_CACHE_LINE, count * stride);
+    if (instances == NULL) {
+        fprintf(stderr, "chip8-cachebench: out of memory\n");
+        return 1;
+    }
+    memset(instances, 0, count * stride);
+
+    /* a different seed and head start per instance, so they execute
+    different code at any given round */
+    for (uint32_t i = 0; i < count; i++) {
+        Chip8 *chip8 = (Chip8 *) (instances + i * stride);
+        chip8_loadmem(chip8, rom, length);
+        chip8_init(chip8);
+        chip8_seed(chip8, i + 1);
+        for (uint32_t s = 0; s < i % 997; s++)
+        chip8_step(chip8);
+    }
+
+    counters_open();
+    double steps = (double) rounds * count;
+    double ns[100];
+    double misses[NUM_COUNTERS][100];
+
+    for (uint32_t k = 0; k < repeats; k++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        counters_enable(true);
+
+        for (uint32_t r = 0; r < rounds; r++) {
+            for (uint32_t i = 0; i < count; i++)
+            chip8_step((Chip8 *) (instances + i * stride));
+        }
+
+        counters_enable(false);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        ns[k] = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / steps;
+        for (size_t c = 0; c < NUM_COUNTERS; c++)
+        misses[c][k] = counters[c].value / steps;
+    }
+
+    printf("%u instances of %zu bytes (%zu lines apart, %zu KB), %u rounds, %u repeats\n", count,
+    sizeof(Chip8), stride / CHIP8_CACHE_LINE, count * stride / 1024, rounds, repeats);
+    printf("per-instruction fields span %d cache line(s)\n", hot_lines());
+    printf("  %-16s %8s %8s\n", "", "min", "median");
+    print_figure("time", ns, repeats, "ns/step");
+    for (size_t c = 0; c < NUM_COUNTERS; c++) {
+        if (counters[c].fd < 0)
+        printf("  %-16s      n/a\n", counters[c].name);
+        else
+        print_figure(counters[c].name, misses[c], repeats, "/step");
+    }
+
+    free(instances);
+    return 0;
+}
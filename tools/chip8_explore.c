@@ -0,0 +1,603 @@
+/*
+State-space explorer. Searches the input sequences of a ROM breadth-first:
+at every decision point each state branches into 17 children, one per
+keypad key held for the next few frames plus one with no key down. States
+are deduplicated by a 64-bit hash of memory, registers and display in a
+lock-free hash set, so each distinct machine state is expanded once.
+
+Each level of the search is spread over all cores. Every worker owns a
+slice of the frontier and steals half of another worker's remaining slice
+when its own runs dry. Because levels are searched in order, the first
+state found for each finding has the shortest input sequence. That
+sequence is written as a movie that tests/golden.c or any movie player can
+replay.
+
+Findings:
+    target          the -t condition holds after a decision
+    stack-overflow  2NNN executed with all 16 stack entries in use
+    stack-underflow 00EE executed with an empty stack
+    pc-overflow     PC left the 4KB address space
+    overlay-full    a write needed more RAM pages than the XIP overlay has
+
+The -t condition is only tested at decision boundaries, every -k frames,
+so a target that holds briefly between two decisions is missed.
+
+A state whose write exhausts the overlay halts and its subtree is not
+searched. Those states are counted per level and in the final report, and
+the first one is reported as overlay-full: a ROM that writes more pages
+than CHIP8_OVERLAY_PAGES (BLINKY needs 24) must be explored with a build
+that raises it, or findings below those states are silently missed.
+Likewise, children that no longer fit in the node or visited table (sized
+by -m) are pruned, counted per level and in the final report, and the
+search stops after that level.
+
+The core is built with CHIP8_XIP for this tool: a savestate is then the
+ROM pointer plus the written pages, about a fifth of the flat layout, which
+is what makes copying and hashing millions of them affordable.
+
+usage: chip8-explore [-j jobs] [-d depth] [-k frames] [-t addr=value|vX=value]
+                     [-m log2-states] [-n frontier] [-s seed] [-o prefix] rom
+*/
+
+#include "Chip8.h"
+#include "Chip8_movie.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef CHIP8_XIP
+#error "chip8-explore needs the execute-in-place backend, build with -DCHIP8_XIP"
+#endif
+
+#define EXPLORE_ACTIONS 17      /* keys 0-F, then no key */
+#define EXPLORE_CHUNK 64        /* frontier states taken from a queue at once */
+#define EXPLORE_NO_NODE UINT32_MAX
+
+typedef enum {
+    FINDING_TARGET = 0,
+    FINDING_STACK_OVERFLOW,
+    FINDING_STACK_UNDERFLOW,
+    FINDING_PC_OVERFLOW,
+    FINDING_OVERLAY_FULL,
+    FINDING_KINDS
+} Explore_finding_kind;
+
+static const char *finding_names[FINDING_KINDS] = {
+    "target", "stack-overflow", "stack-underflow", "pc-overflow", "overlay-full"
+};
+
+/* how each explored state was reached, for rebuilding input sequences */
+typedef struct Explore_node_t {
+    uint32_t parent;
+    uint8_t action;
+} Explore_node;
+
+/* a worker's slice [begin, end) of the current frontier */
+typedef struct Explore_queue_t {
+    atomic_flag lock;
+    uint32_t begin;
+    uint32_t end;
+} __attribute__((aligned(64))) Explore_queue;
+
+typedef struct Explore_worker_t {
+    pthread_t thread;
+    int id;
+    uint64_t generated;
+    /* children halted by a full overlay, not searched further */
+    uint64_t overlay_full;
+    /* children pruned because the node or visited table was full */
+    uint64_t table_full;
+} __attribute__((aligned(64))) Explore_worker;
+
+/* search parameters */
+static int num_workers;
+static uint32_t max_depth = 32;
+static uint32_t frames_per_decision = 4;
+static uint32_t frontier_capacity = 1 << 16;
+static uint32_t seed = 0xC8C8C8C8;
+
+/* -t condition: memory byte, or register when target_reg >= 0 */
+static bool have_target;
+static int target_reg = -1;
+static uint16_t target_addr;
+static uint8_t target_value;
+
+/* concurrent hash set of visited states; 0 marks an empty slot */
+static _Atomic uint64_t *visited;
+static uint64_t visited_mask;
+static _Atomic uint64_t visited_count;
+
+static Explore_node *nodes;
+static _Atomic uint32_t node_count;
+static uint32_t node_capacity;
+
+/* current and next level of the search, states and their nodes kept apart
+so the cache-line aligned states pack without padding */
+static Chip8 *frontier;
+static Chip8 *next_frontier;
+static uint32_t *frontier_nodes;
+static uint32_t *next_frontier_nodes;
+static uint32_t frontier_size;
+static _Atomic uint32_t next_size;
+static _Atomic uint64_t dropped;
+
+static Explore_queue *queues;
+static Explore_worker *workers;
+static pthread_barrier_t level_barrier;
+static uint32_t depth;
+static bool done;
+
+static _Atomic uint32_t findings[FINDING_KINDS];
+static uint32_t finding_depth[FINDING_KINDS];
+
+/*
+64-bit hash over 8-byte words: a multiply-xorshift per word and the
+splitmix64 finalizer at the end
+*/
+static inline uint64_t explore_mix(uint64_t h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint64_t w;
+
+    for (; len >= 8; len -= 8, p += 8) {
+        memcpy(&w, p, 8);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    if (len > 0) {
+        w = 0;
+        memcpy(&w, p, len);
+        h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+/*
+Hashes everything that decides the machine's future: registers, the live
+part of the stack, timers, RNG, display and the written memory pages. The
+frame counter and the keypad, which the explorer sets itself, are left out
+*/
+static uint64_t explore_hash(const Chip8 *chip8) {
+    uint64_t h = 0xCBF29CE484222325ULL;
+
+    h = explore_mix(h, chip8->regV, sizeof(chip8->regV));
+    h = explore_mix(h, chip8->stack, chip8->sp < 16 ? chip8->sp * sizeof(chip8->stack[0]) : sizeof(chip8->stack));
+    uint8_t scalars[12] = {
+        chip8->pc, chip8->pc >> 8, chip8->regI, chip8->regI >> 8, chip8->sp, chip8->delay, chip8->sound,
+        chip8->rng, chip8->rng >> 8, chip8->rng >> 16, chip8->rng >> 24, chip8->overlay_used
+    };
+    h = explore_mix(h, scalars, sizeof(scalars));
+    h = explore_mix(h, chip8->display, sizeof(chip8->display));
+    h = explore_mix(h, chip8->page_map, sizeof(chip8->page_map));
+    h = explore_mix(h, chip8->overlay, chip8->overlay_used * CHIP8_PAGE_SIZE);
+
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h ? h : 1;
+}
+
+typedef enum {
+    VISITED_NEW,
+    VISITED_SEEN,
+    /* every slot is taken, so whether the state is new cannot be told */
+    VISITED_FULL
+} Explore_visit;
+
+static Explore_visit visited_insert(uint64_t h) {
+    uint64_t i = h & visited_mask;
+
+    for (uint64_t probes = 0; probes <= visited_mask; probes++, i = (i + 1) & visited_mask) {
+        uint64_t slot = atomic_load_explicit(&visited[i], memory_order_relaxed);
+        if (slot == h)
+        return VISITED_SEEN;
+        if (slot == 0) {
+            if (atomic_compare_exchange_strong_explicit(&visited[i], &slot, h, memory_order_relaxed,
+            memory_order_relaxed)) {
+                atomic_fetch_add_explicit(&visited_count, 1, memory_order_relaxed);
+                return VISITED_NEW;
+            }
+            if (slot == h)
+            return VISITED_SEEN;
+        }
+    }
+    return VISITED_FULL;
+}
+
+static void explore_record(Explore_finding_kind kind, uint32_t node) {
+    uint32_t none = EXPLORE_NO_NODE;
+    if (atomic_compare_exchange_strong(&findings[kind], &none, node))
+    finding_depth[kind] = depth + 1;
+}
+
+/*
+Runs one emulated frame exactly as chip8_frame does, except that every
+instruction is checked first for the faults the explorer looks for, which
+would otherwise corrupt the instance. Returns the fault, or FINDING_KINDS
+*/
+static Explore_finding_kind explore_frame(Chip8 *chip8) {
+    for (uint16_t i = 0; i < CHIP8_CYCLES_PER_FRAME && !chip8->halt; i++) {
+        if (chip8->pc > CHIP8_MEMSIZE - 2)
+        return FINDING_PC_OVERFLOW;
+
+        uint16_t instruction = (chip8_mem_read(chip8, chip8->pc) << 8) | chip8_mem_read(chip8, chip8->pc + 1);
+        if ((instruction & 0xF000) == 0x2000 && chip8->sp >= 16)
+        return FINDING_STACK_OVERFLOW;
+        if (instruction == 0x00EE && chip8->sp == 0)
+        return FINDING_STACK_UNDERFLOW;
+
+        chip8_step(chip8);
+    }
+    chip8_tick_timers(chip8);
+    return FINDING_KINDS;
+}
+
+static bool explore_target(const Chip8 *chip8) {
+    if (target_reg >= 0)
+    return chip8->regV[target_reg] == target_value;
+    return chip8_mem_read(chip8, target_addr) == target_value;
+}
+
+/* Runs every action from a frontier state and queues the new children */
+static void explore_expand(Explore_worker *worker, const Chip8 *state, uint32_t parent) {
+    Chip8 child;
+
+    for (uint8_t action = 0; action < EXPLORE_ACTIONS; action++) {
+        child = *state;
+        child.keypad = action < 16 ? 1 << action : 0;
+
+        Explore_finding_kind fault = FINDING_KINDS;
+        for (uint32_t f = 0; f < frames_per_decision && fault == FINDING_KINDS && !child.halt; f++)
+        fault = explore_frame(&child);
+        worker->generated++;
+
+        /* an exhausted overlay halts the machine, so the subtree below is
+        lost to the search: count it, and report the first one */
+        if (child.halt) {
+            worker->overlay_full++;
+            if (atomic_load_explicit(&findings[FINDING_OVERLAY_FULL], memory_order_relaxed) != EXPLORE_NO_NODE)
+            continue;
+            fault = FINDING_OVERLAY_FULL;
+        }
+        if (fault == FINDING_KINDS) {
+            Explore_visit visit = visited_insert(explore_hash(&child));
+            if (visit == VISITED_FULL)
+            worker->table_full++;
+            if (visit != VISITED_NEW)
+            continue;
+        }
+
+        /* a child without a node cannot be traced back to its inputs, so
+        it is pruned like one the visited table has no room for */
+        uint32_t node = atomic_fetch_add_explicit(&node_count, 1, memory_order_relaxed);
+        if (node >= node_capacity) {
+            worker->table_full++;
+            continue;
+        }
+        nodes[node].parent = parent;
+        nodes[node].action = action;
+
+        if (fault != FINDING_KINDS) {
+            explore_record(fault, node);
+            continue;
+        }
+        if (have_target && explore_target(&child))
+        explore_record(FINDING_TARGET, node);
+
+        uint32_t slot = atomic_fetch_add_explicit(&next_size, 1, memory_order_relaxed);
+        if (slot >= frontier_capacity) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+            continue;
+        }
+        next_frontier_nodes[slot] = node;
+        next_frontier[slot] = child;
+    }
+}
+
+static void queue_lock(Explore_queue *q) {
+    while (atomic_flag_test_and_set_explicit(&q->lock, memory_order_acquire))
+    ;
+}
+
+static void queue_unlock(Explore_queue *q) {
+    atomic_flag_clear_explicit(&q->lock, memory_order_release);
+}
+
+/* Takes the next chunk of the worker's own slice */
+static bool queue_take(Explore_queue *q, uint32_t *begin, uint32_t *end) {
+    queue_lock(q);
+    *begin = q->begin;
+    *end = q->end - q->begin > EXPLORE_CHUNK ? q->begin + EXPLORE_CHUNK : q->end;
+    q->begin = *end;
+    queue_unlock(q);
+    return *begin < *end;
+}
+
+/* Moves the back half of the first other queue, in worker order after the
+thief, that has at least two states left into the thief's own */
+static bool queue_steal(int thief) {
+    for (int i = 1; i < num_workers; i++) {
+        Explore_queue *victim = &queues[(thief + i) % num_workers];
+
+        queue_lock(victim);
+        uint32_t left = victim->end - victim->begin;
+        if (left < 2) {
+            queue_unlock(victim);
+            continue;
+        }
+        uint32_t mid = victim->begin + left / 2;
+        uint32_t end = victim->end;
+        victim->end = mid;
+        queue_unlock(victim);
+
+        queue_lock(&queues[thief]);
+        queues[thief].begin = mid;
+        queues[thief].end = end;
+        queue_unlock(&queues[thief]);
+        return true;
+    }
+    return false;
+}
+
+/* Splits the frontier evenly over the workers' queues */
+static void explore_distribute() {
+    for (int w = 0; w < num_workers; w++) {
+        queues[w].begin = (uint64_t) frontier_size * w / num_workers;
+        queues[w].end = (uint64_t) frontier_size * (w + 1) / num_workers;
+    }
+}
+
+static double seconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static struct timespec search_start;
+
+/* Ends a level: swaps frontiers and decides whether to go on. Run by
+worker 0 while the others wait at the barrier */
+static void explore_next_level() {
+    uint64_t generated = 0;
+    uint64_t overlay_full = 0;
+    uint64_t table_full = 0;
+    for (int w = 0; w < num_workers; w++) {
+        generated += workers[w].generated;
+        overlay_full += workers[w].overlay_full;
+        table_full += workers[w].table_full;
+    }
+
+    uint32_t size = atomic_load(&next_size);
+    if (size > frontier_capacity)
+    size = frontier_capacity;
+
+    double elapsed = seconds_since(&search_start);
+    printf("depth %3u: %9u new states, %10llu unique, %12llu run, %6.2f M states/s", depth + 1, size,
+    (unsigned long long) atomic_load(&visited_count), (unsigned long long) generated,
+    elapsed > 0 ? generated / elapsed / 1e6 : 0.0);
+    if (overlay_full > 0)
+    printf(", %llu overlay full", (unsigned long long) overlay_full);
+    if (table_full > 0)
+    printf(", %llu pruned (tables full)", (unsigned long long) table_full);
+    printf("\n");
+
+    Chip8 *t = frontier;
+    frontier = next_frontier;
+    next_frontier = t;
+    uint32_t *tn = frontier_nodes;
+    frontier_nodes = next_frontier_nodes;
+    next_frontier_nodes = tn;
+    frontier_size = size;
+    atomic_store(&next_size, 0);
+    depth++;
+
+    done = size == 0 || depth >= max_depth || atomic_load(&node_count) >= node_capacity
+    || atomic_load(&visited_count) > visited_mask / 4 * 3;
+    if (!done)
+    explore_distribute();
+}
+
+static void *explore_worker(void *arg) {
+    Explore_worker *worker = arg;
+    uint32_t begin, end;
+
+    while (!done) {
+        for (;;) {
+            while (queue_take(&queues[worker->id], &begin, &end)) {
+                for (uint32_t i = begin; i < end; i++)
+                explore_expand(worker, &frontier[i], frontier_nodes[i]);
+            }
+            /* nothing is added to a level while it runs, so once every
+            queue is empty the level is finished */
+            if (!queue_steal(worker->id))
+            break;
+        }
+
+        pthread_barrier_wait(&level_barrier);
+        if (worker->id == 0)
+        explore_next_level();
+        pthread_barrier_wait(&level_barrier);
+    }
+
+    return NULL;
+}
+
+/* Rebuilds the input sequence leading to a node as a movie */
+static bool explore_save_movie(uint32_t node, const char *filename) {
+    uint8_t path[1024];
+    uint32_t length = 0;
+    Chip8_movie movie = {0};
+
+    for (uint32_t n = node; n != 0 && length < sizeof(path); n = nodes[n].parent)
+    path[length++] = nodes[n].action;
+
+    movie.seed = seed;
+    for (uint32_t d = 0; d < length; d++) {
+        uint8_t action = path[length - 1 - d];
+        chip8_movie_append(&movie, d * frames_per_decision, action < 16 ? 1 << action : 0);
+    }
+
+    bool ok = chip8_movie_save(&movie, filename);
+    chip8_movie_free(&movie);
+    return ok;
+}
+
+static bool parse_target(const char *spec) {
+    char *end;
+
+    if (spec[0] == 'v' || spec[0] == 'V') {
+        target_reg = strtoul(spec + 1, &end, 16);
+        if (end == spec + 1 || target_reg > 0xF)
+        return false;
+    }
+    else {
+        target_addr = strtoul(spec, &end, 0);
+        if (end == spec || target_addr >= CHIP8_MEMSIZE)
+        return false;
+    }
+    if (*end != '=')
+    return false;
+    target_value = strtoul(end + 1, &end, 0);
+    have_target = true;
+    return *end == '\0';
+}
+
+static void usage() {
+    fprintf(stderr, "usage: chip8-explore [-j jobs] [-d depth] [-k frames] [-t addr=value|vX=value]\n"
+    "                     [-m log2-states] [-n frontier] [-s seed] [-o prefix] rom\n"
+    "-t is tested after each decision, every -k frames, not after every instruction\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t log2_states = 24;
+    const char *prefix = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:d:k:t:m:n:s:o:")) != -1) {
+        switch (opt) {
+            case 'j': threads = atol(optarg); break;
+            case 'd': max_depth = strtoul(optarg, NULL, 0); break;
+            case 'k': frames_per_decision = strtoul(optarg, NULL, 0); break;
+            case 't': if (!parse_target(optarg)) usage(); break;
+            case 'm': log2_states = strtoul(optarg, NULL, 0); break;
+            case 'n': frontier_capacity = strtoul(optarg, NULL, 0); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            case 'o': prefix = optarg; break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1 || frames_per_decision == 0 || max_depth == 0 || max_depth > 1024 || log2_states < 10 || log2_states > 32
+    || frontier_capacity == 0)
+    usage();
+    if (threads < 1)
+    threads = 1;
+    num_workers = threads;
+
+    const char *rom_path = argv[optind];
+    FILE *fp = fopen(rom_path, "rb");
+    if (fp == NULL) {
+        perror(rom_path);
+        return 1;
+    }
+    /* executed in place by every state, so it outlives the search */
+    static uint8_t rom[CHIP8_MEMSIZE];
+    uint16_t length = fread(rom, 1, CHIP8_MEMSIZE - 0x200, fp);
+    fclose(fp);
+
+    if (prefix == NULL)
+    prefix = strrchr(rom_path, '/') ? strrchr(rom_path, '/') + 1 : rom_path;
+
+    visited_mask = (1ULL << log2_states) - 1;
+    visited = calloc(visited_mask + 1, sizeof(uint64_t));
+    node_capacity = visited_mask / 4 * 3 + 1;
+    nodes = malloc(node_capacity * sizeof(Explore_node));
+    frontier = aligned_alloc(CHIP8_CACHE_LINE, frontier_capacity * sizeof(Chip8));
+    next_frontier = aligned_alloc(CHIP8_CACHE_LINE, frontier_capacity * sizeof(Chip8));
+    frontier_nodes = malloc(frontier_capacity * sizeof(uint32_t));
+    next_frontier_nodes = malloc(frontier_capacity * sizeof(uint32_t));
+    queues = aligned_alloc(CHIP8_CACHE_LINE, num_workers * sizeof(Explore_queue));
+    workers = aligned_alloc(CHIP8_CACHE_LINE, num_workers * sizeof(Explore_worker));
+    if (visited == NULL || nodes == NULL || frontier == NULL || next_frontier == NULL || frontier_nodes == NULL
+    || next_frontier_nodes == NULL || queues == NULL || workers == NULL) {
+        fprintf(stderr, "chip8-explore: out of memory, lower -m or -n\n");
+        return 1;
+    }
+
+    memset(queues, 0, num_workers * sizeof(Explore_queue));
+    memset(workers, 0, num_workers * sizeof(Explore_worker));
+
+    /* the root: node 0, the machine right after power-on */
+    Chip8 *root = &frontier[0];
+    memset(root, 0, sizeof(Chip8));
+    chip8_loadmem(root, rom, length);
+    chip8_init(root);
+    chip8_seed(root, seed);
+    visited_insert(explore_hash(root));
+    frontier_nodes[0] = 0;
+    nodes[0].parent = EXPLORE_NO_NODE;
+    atomic_store(&node_count, 1);
+    frontier_size = 1;
+    for (int k = 0; k < FINDING_KINDS; k++)
+    atomic_store(&findings[k], EXPLORE_NO_NODE);
+
+    printf("exploring %s: %d threads, %u frames per decision, %zu byte states\n", rom_path, num_workers,
+    frames_per_decision, sizeof(Chip8));
+
+    clock_gettime(CLOCK_MONOTONIC, &search_start);
+    explore_distribute();
+    pthread_barrier_init(&level_barrier, NULL, num_workers);
+    for (int w = 0; w < num_workers; w++) {
+        workers[w].id = w;
+        pthread_create(&workers[w].thread, NULL, explore_worker, &workers[w]);
+    }
+    for (int w = 0; w < num_workers; w++)
+    pthread_join(workers[w].thread, NULL);
+    pthread_barrier_destroy(&level_barrier);
+
+    uint64_t generated = 0;
+    uint64_t overlay_full = 0;
+    uint64_t table_full = 0;
+    for (int w = 0; w < num_workers; w++) {
+        generated += workers[w].generated;
+        overlay_full += workers[w].overlay_full;
+        table_full += workers[w].table_full;
+    }
+    double elapsed = seconds_since(&search_start);
+    printf("%llu states run, %llu unique, %.3f s, %.2f M states/s", (unsigned long long) generated,
+    (unsigned long long) atomic_load(&visited_count), elapsed, generated / elapsed / 1e6);
+    if (atomic_load(&dropped) > 0)
+    printf(", %llu states dropped (frontier full, raise -n)", (unsigned long long) atomic_load(&dropped));
+    if (overlay_full > 0)
+    printf(", %llu states not searched (overlay full, raise CHIP8_OVERLAY_PAGES from %d)",
+    (unsigned long long) overlay_full, CHIP8_OVERLAY_PAGES);
+    if (table_full > 0)
+    printf(", %llu states pruned (node or visited table full, raise -m)", (unsigned long long) table_full);
+    printf("\n");
+
+    int found = 0;
+    for (int k = 0; k < FINDING_KINDS; k++) {
+        uint32_t node = atomic_load(&findings[k]);
+        if (node == EXPLORE_NO_NODE)
+        continue;
+
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s-%s.movie", prefix, finding_names[k]);
+        if (!explore_save_movie(node, filename)) {
+            perror(filename);
+            return 1;
+        }
+        printf("%s: after %u decisions (%u frames), wrote %s\n", finding_names[k], finding_depth[k],
+        finding_depth[k] * frames_per_decision, filename);
+        found++;
+    }
+    if (found == 0)
+    printf("no findings\n");
+
+    return 0;
+}
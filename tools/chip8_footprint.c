@@ -0,0 +1,22 @@
+/*
+Reports the RAM footprint of one Chip8 instance for the memory backend
+this file was compiled with. Built and run once per configuration by
+`make footprint`.
+*/
+
+#include "Chip8.h"
+#include <stddef.h>
+
+int main(void) {
+    #ifdef CHIP8_XIP
+    printf("backend: xip, %d pages of %d bytes\n", CHIP8_OVERLAY_PAGES, CHIP8_PAGE_SIZE);
+    printf("  overlay:       %5zu bytes\n", sizeof(((Chip8 *) 0)->overlay));
+    printf("  page map:      %5zu bytes\n", sizeof(((Chip8 *) 0)->page_map));
+    #else
+    printf("backend: flat\n");
+    printf("  memory:        %5zu bytes\n", sizeof(((Chip8 *) 0)->memory));
+    #endif
+    printf("  display:       %5zu bytes\n", sizeof(((Chip8 *) 0)->display));
+    printf("  sizeof(Chip8): %5zu bytes\n", sizeof(Chip8));
+    return 0;
+}
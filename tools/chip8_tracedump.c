@@ -0,0 +1,127 @@
+/*
+Offline decoder for binary traces written by Chip8_trace. Prints a
+disassembled listing, optionally filtered by PC, opcode or frame range,
+or a per-opcode summary of the trace.
+
+usage: chip8-tracedump [-p pc] [-o value[/mask]] [-f first] [-l last] [-s] file
+*/
+
+#include "Chip8.h"
+#include "Chip8_trace.h"
+#include <string.h>
+#include <unistd.h>
+
+static void usage(){
+    fprintf(stderr, "usage: chip8-tracedump [-p pc] [-o value[/mask]] "
+    "[-f first-frame] [-l last-frame] [-s] tracefile\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    Chip8_trace_trigger pc_filter = {0};
+    Chip8_trace_trigger op_filter = {0};
+    uint32_t first = 0;
+    uint32_t last = UINT32_MAX;
+    bool summary = false;
+    char spec[64];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:o:f:l:s")) != -1) {
+        switch (opt) {
+            case 'p':
+            snprintf(spec, sizeof(spec), "pc:%s", optarg);
+            if (!chip8_trace_parse_trigger(spec, &pc_filter)) usage();
+            break;
+            case 'o':
+            snprintf(spec, sizeof(spec), "op:%s", optarg);
+            if (!chip8_trace_parse_trigger(spec, &op_filter)) usage();
+            break;
+            case 'f': first = strtoul(optarg, NULL, 0); break;
+            case 'l': last = strtoul(optarg, NULL, 0); break;
+            case 's': summary = true; break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1)
+    usage();
+
+    FILE *fp = fopen(argv[optind], "rb");
+    if (fp == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    Chip8_trace_header header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, CHIP8_TRACE_MAGIC, 4) != 0
+    || header.version != CHIP8_TRACE_VERSION || header.record_size != sizeof(Chip8_trace_record)) {
+        fprintf(stderr, "%s: not a chip8 trace\n", argv[optind]);
+        return 1;
+    }
+
+    uint64_t counts[16] = {0};
+    uint64_t total = 0;
+    Chip8_trace_record r;
+    char text[32];
+
+    /* set by each frame record, and followed through the instructions in
+    between: FX15/FX18 load the timers, 2NNN and 00EE move SP. A frame
+    record already includes the effect of the instruction after it */
+    uint32_t frame = 0;
+    uint8_t delay = 0, sound = 0, sp = 0;
+    bool sampled = false;
+
+    if (!summary)
+    printf("%-8s %-5s %-5s %-16s %-8s %-4s %-5s %-3s %-3s %-2s\n",
+    "FRAME", "PC", "INSTR", "DISASM", "VX", "VF", "I", "DT", "ST", "SP");
+
+    while (fread(&r, sizeof(r), 1, fp) == 1) {
+        if (r.step.pc & CHIP8_TRACE_FRAME_TAG) {
+            frame = r.frame.frame;
+            delay = r.frame.delay;
+            sound = r.frame.sound;
+            sp = r.frame.tag & 0xFF;
+            sampled = true;
+            continue;
+        }
+
+        uint16_t instruction = r.step.instruction;
+        if (sampled)
+        sampled = false;
+        else if ((instruction & 0xF0FF) == 0xF015)
+        delay = r.step.value;
+        else if ((instruction & 0xF0FF) == 0xF018)
+        sound = r.step.value;
+        else if ((instruction & 0xF000) == 0x2000)
+        sp++;
+        else if (instruction == 0x00EE)
+        sp--;
+
+        if (frame < first || frame > last)
+        continue;
+        if (pc_filter.kind != CHIP8_TRIGGER_NONE && r.step.pc != pc_filter.value)
+        continue;
+        if (op_filter.kind != CHIP8_TRIGGER_NONE && (instruction & op_filter.mask) != op_filter.value)
+        continue;
+
+        total++;
+        if (summary) {
+            counts[instruction >> 12]++;
+            continue;
+        }
+
+        chip8_disassemble(instruction, text, sizeof(text));
+        printf("%-8u 0x%03X %04X  %-16s V%X=0x%02X 0x%02X 0x%03X %-3u %-3u %-2u\n",
+        frame, r.step.pc, instruction, text, (instruction & 0x0F00) >> 8, r.step.value, r.step.vf,
+        r.step.regI, delay, sound, sp);
+    }
+
+    if (summary) {
+        for (int i = 0; i < 16; i++)
+        printf("%XNNN %12llu %6.2f%%\n", i, (unsigned long long) counts[i],
+        total ? 100.0 * counts[i] / total : 0.0);
+        printf("TOTAL %11llu\n", (unsigned long long) total);
+    }
+
+    fclose(fp);
+    return 0;
+}